@@ -464,6 +464,55 @@ int dhara_journal_resume(struct dhara_journal *j, dhara_error_t *err)
 	return 0;
 }
 
+int dhara_journal_restore(struct dhara_journal *j, dhara_page_t root,
+			  uint8_t epoch, dhara_error_t *err)
+{
+	const dhara_page_t cp = root + 1;
+
+	/* The checkpoint page must close a checkpoint group and carry a
+	 * header from the same epoch.
+	 */
+	if ((root == DHARA_PAGE_NONE) ||
+	    (cp >= (j->nand->num_blocks << j->nand->log2_ppb)) ||
+	    !is_aligned(cp + 1, j->log2_ppc)) {
+		dhara_set_error(err, DHARA_E_NOT_FOUND);
+		reset_journal(j);
+		return -1;
+	}
+
+	if (dhara_nand_read(j->nand, cp, 0, 1 << j->nand->log2_page_size,
+			    j->page_buf, err) < 0) {
+		reset_journal(j);
+		return -1;
+	}
+
+	if (!hdr_has_magic(j->page_buf) ||
+	    (hdr_get_epoch(j->page_buf) != epoch)) {
+		dhara_set_error(err, DHARA_E_NOT_FOUND);
+		reset_journal(j);
+		return -1;
+	}
+
+	j->epoch = epoch;
+	j->root = root;
+	j->tail = hdr_get_tail(j->page_buf);
+	j->bb_current = hdr_get_bb_current(j->page_buf);
+	j->bb_last = hdr_get_bb_last(j->page_buf);
+	hdr_clear_user(j->page_buf, j->nand->log2_page_size);
+
+	if (find_head(j, cp & ~(dhara_page_t)((1 << j->log2_ppc) - 1),
+		      err) < 0) {
+		reset_journal(j);
+		return -1;
+	}
+
+	j->flags = 0;
+	j->tail_sync = j->tail;
+
+	clear_recovery(j);
+	return 0;
+}
+
 /**************************************************************************
  * Public interface
  */
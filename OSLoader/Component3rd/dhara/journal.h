@@ -140,6 +140,17 @@ void dhara_journal_init(struct dhara_journal *j,
  */
 int dhara_journal_resume(struct dhara_journal *j, dhara_error_t *err);
 
+/* Start up the journal from a checkpoint whose location is already
+ * known, skipping the search done by dhara_journal_resume(). The root is
+ * the last user page before the checkpoint page, as reported by
+ * dhara_journal_root() after a sync. Returns -1 and leaves an empty
+ * journal if that page does not hold a checkpoint of the given epoch.
+ *
+ * This operation is O(1).
+ */
+int dhara_journal_restore(struct dhara_journal *j, dhara_page_t root,
+			  uint8_t epoch, dhara_error_t *err);
+
 /* Obtain an upper bound on the number of user pages storable in the
  * journal.
  */
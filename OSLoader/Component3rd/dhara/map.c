@@ -66,6 +66,74 @@ static inline void meta_set_alt(uint8_t *meta, int level, dhara_page_t alt)
 	dhara_w32(meta + 4 + (level << 2), alt);
 }
 
+/************************************************************************
+ * Translation cache
+ */
+
+/* Slot value of a sector whose location isn't known */
+#define CACHE_UNKNOWN		((dhara_page_t)0xfffffffe)
+
+static inline dhara_page_t *cache_slot(struct dhara_map *m,
+				       dhara_sector_t s)
+{
+	if (!m->c_page)
+		return NULL;
+
+	if (!m->c_tag)
+		return (s < m->c_size) ? &m->c_page[s] : NULL;
+
+	return &m->c_page[s & (m->c_size - 1)];
+}
+
+/* Returns the cached page of s (DHARA_PAGE_NONE if it is known to be
+ * unmapped), or CACHE_UNKNOWN.
+ */
+static dhara_page_t cache_get(struct dhara_map *m, dhara_sector_t s)
+{
+	dhara_page_t *slot = cache_slot(m, s);
+
+	if (!slot || (*slot == CACHE_UNKNOWN) ||
+	    (m->c_tag && m->c_tag[s & (m->c_size - 1)] != s))
+		return CACHE_UNKNOWN;
+
+	return *slot;
+}
+
+static void cache_put(struct dhara_map *m, dhara_sector_t s,
+		      dhara_page_t p)
+{
+	dhara_page_t *slot = cache_slot(m, s);
+
+	if (!slot || (s == DHARA_SECTOR_NONE))
+		return;
+
+	*slot = p;
+	if (m->c_tag)
+		m->c_tag[s & (m->c_size - 1)] = s;
+}
+
+void dhara_map_cache_init(struct dhara_map *m, dhara_page_t *page,
+			  dhara_sector_t *tag, dhara_sector_t slots)
+{
+	m->c_page = page;
+	m->c_tag = tag;
+	m->c_size = slots;
+	m->c_hits = 0;
+	m->c_misses = 0;
+	dhara_map_cache_flush(m);
+}
+
+void dhara_map_cache_flush(struct dhara_map *m)
+{
+	dhara_sector_t i;
+
+	if (!m->c_page)
+		return;
+
+	for (i = 0; i < m->c_size; i++)
+		m->c_page[i] = CACHE_UNKNOWN;
+}
+
 /************************************************************************
  * Public interface
  */
@@ -78,10 +146,16 @@ void dhara_map_init(struct dhara_map *m, const struct dhara_nand *n,
 
 	dhara_journal_init(&m->journal, n, page_buf);
 	m->gc_ratio = gc_ratio;
+	m->gc_write_ratio = gc_ratio;
+	m->c_page = NULL;
+	m->c_tag = NULL;
+	m->c_size = 0;
 }
 
 int dhara_map_resume(struct dhara_map *m, dhara_error_t *err)
 {
+	dhara_map_cache_flush(m);
+
 	if (dhara_journal_resume(&m->journal, err) < 0) {
 		m->count = 0;
 		return -1;
@@ -91,12 +165,28 @@ int dhara_map_resume(struct dhara_map *m, dhara_error_t *err)
 	return 0;
 }
 
+int dhara_map_restore(struct dhara_map *m, dhara_page_t root,
+		      uint8_t epoch, dhara_error_t *err)
+{
+	dhara_map_cache_flush(m);
+
+	if (dhara_journal_restore(&m->journal, root, epoch, err) < 0) {
+		m->count = 0;
+		return -1;
+	}
+
+	m->count = ck_get_count(dhara_journal_cookie(&m->journal));
+	return 0;
+}
+
 void dhara_map_clear(struct dhara_map *m)
 {
 	if (m->count) {
 		m->count = 0;
 		dhara_journal_clear(&m->journal);
 	}
+
+	dhara_map_cache_flush(m);
 }
 
 dhara_sector_t dhara_map_capacity(const struct dhara_map *m)
@@ -184,7 +274,41 @@ not_found:
 int dhara_map_find(struct dhara_map *m, dhara_sector_t target,
 		   dhara_page_t *loc, dhara_error_t *err)
 {
-	return trace_path(m, target, loc, NULL, err);
+	dhara_page_t p = cache_get(m, target);
+	dhara_error_t my_err;
+
+	if (p != CACHE_UNKNOWN) {
+		m->c_hits++;
+
+		if (p == DHARA_PAGE_NONE) {
+			dhara_set_error(err, DHARA_E_NOT_FOUND);
+			return -1;
+		}
+
+		if (loc)
+			*loc = p;
+
+		return 0;
+	}
+
+	if (!m->c_page)
+		return trace_path(m, target, loc, NULL, err);
+
+	m->c_misses++;
+
+	if (trace_path(m, target, &p, NULL, &my_err) < 0) {
+		if (my_err == DHARA_E_NOT_FOUND)
+			cache_put(m, target, DHARA_PAGE_NONE);
+
+		dhara_set_error(err, my_err);
+		return -1;
+	}
+
+	cache_put(m, target, p);
+	if (loc)
+		*loc = p;
+
+	return 0;
 }
 
 int dhara_map_read(struct dhara_map *m, dhara_sector_t s,
@@ -227,6 +351,13 @@ static int raw_gc(struct dhara_map *m, dhara_page_t src,
 	if (target == DHARA_SECTOR_NONE)
 		return 0;
 
+	/* A cached location other than src means the page is stale, no
+	 * need to walk the tree to find out.
+	 */
+	current = cache_get(m, target);
+	if ((current != CACHE_UNKNOWN) && (current != src))
+		return 0;
+
 	/* Find out where the sector once represented by this page
 	 * currently resides (if anywhere).
 	 */
@@ -249,6 +380,7 @@ static int raw_gc(struct dhara_map *m, dhara_page_t src,
 	if (dhara_journal_copy(&m->journal, src, meta, err) < 0)
 		return -1;
 
+	cache_put(m, target, dhara_journal_root(&m->journal));
 	return 0;
 }
 
@@ -265,7 +397,11 @@ static int pad_queue(struct dhara_map *m, dhara_error_t *err)
 	if (dhara_journal_read_meta(&m->journal, p, root_meta, err) < 0)
 		return -1;
 
-	return dhara_journal_copy(&m->journal, p, root_meta, err);
+	if (dhara_journal_copy(&m->journal, p, root_meta, err) < 0)
+		return -1;
+
+	cache_put(m, meta_get_id(root_meta), dhara_journal_root(&m->journal));
+	return 0;
 }
 
 /* Attempt to recover the journal */
@@ -279,6 +415,11 @@ static int try_recover(struct dhara_map *m, dhara_error_t cause,
 		return -1;
 	}
 
+	/* Recovery relocates pages and may rewind the root when it has to
+	 * restart, cached locations can't be trusted across it.
+	 */
+	dhara_map_cache_flush(m);
+
 	while (dhara_journal_in_recovery(&m->journal)) {
 		dhara_page_t p = dhara_journal_next_recoverable(&m->journal);
 		dhara_error_t my_err;
@@ -301,21 +442,57 @@ static int try_recover(struct dhara_map *m, dhara_error_t cause,
 			}
 
 			restart_count++;
+			dhara_map_cache_flush(m);
 		}
 	}
 
 	return 0;
 }
 
+int dhara_map_refresh(struct dhara_map *m, dhara_page_t src,
+		      dhara_error_t *err)
+{
+	for (;;) {
+		dhara_error_t my_err;
+
+		if (!raw_gc(m, src, &my_err))
+			return 0;
+
+		if (try_recover(m, my_err, err) < 0)
+			return -1;
+	}
+}
+
+void dhara_map_set_gc_ratio(struct dhara_map *m, uint8_t ratio)
+{
+	if (ratio > m->gc_ratio)
+		ratio = m->gc_ratio;
+
+	m->gc_write_ratio = ratio;
+}
+
+int dhara_map_gc_wanted(const struct dhara_map *m, dhara_page_t headroom)
+{
+	return dhara_journal_size(&m->journal) + headroom >=
+		dhara_map_capacity(m);
+}
+
 static int auto_gc(struct dhara_map *m, dhara_error_t *err)
 {
+	const dhara_page_t size = dhara_journal_size(&m->journal);
+	const dhara_sector_t cap = dhara_map_capacity(m);
+	int ratio = m->gc_write_ratio;
 	int i;
 
-	if (dhara_journal_size(&m->journal) < dhara_map_capacity(m))
+	if (size < cap)
 		return 0;
 
+	/* Deferred collection has used half of the reserve */
+	if ((size - cap) * 2 >= dhara_journal_capacity(&m->journal) - cap)
+		ratio = m->gc_ratio;
+
 	//printf("FTL: Start GC\n");
-	for (i = 0; i <= m->gc_ratio; i++)
+	for (i = 0; i <= ratio; i++)
 		if (dhara_map_gc(m, err) < 0)
 			return -1;
 	
@@ -360,8 +537,10 @@ int dhara_map_write(struct dhara_map *m, dhara_sector_t dst,
 		if (prepare_write(m, dst, meta, err) < 0)
 			return -1;
 
-		if (!dhara_journal_enqueue(&m->journal, data, meta, &my_err))
+		if (!dhara_journal_enqueue(&m->journal, data, meta, &my_err)) {
+			cache_put(m, dst, dhara_journal_root(&m->journal));
 			break;
+		}
 
 		m->count = old_count;
 
@@ -383,8 +562,10 @@ int dhara_map_copy_page(struct dhara_map *m, dhara_page_t src,
 		if (prepare_write(m, dst, meta, err) < 0)
 			return -1;
 
-		if (!dhara_journal_copy(&m->journal, src, meta, &my_err))
+		if (!dhara_journal_copy(&m->journal, src, meta, &my_err)) {
+			cache_put(m, dst, dhara_journal_root(&m->journal));
 			break;
+		}
 
 		m->count = old_count;
 
@@ -423,8 +604,10 @@ static int try_delete(struct dhara_map *m, dhara_sector_t s,
 	int i;
 
 	if (trace_path(m, s, NULL, meta, &my_err) < 0) {
-		if (my_err == DHARA_E_NOT_FOUND)
+		if (my_err == DHARA_E_NOT_FOUND) {
+			cache_put(m, s, DHARA_PAGE_NONE);
 			return 0;
+		}
 
 		dhara_set_error(err, my_err);
 		return -1;
@@ -444,6 +627,8 @@ static int try_delete(struct dhara_map *m, dhara_sector_t s,
 	if (level < 0) {
 		m->count = 0;
 		dhara_journal_clear(&m->journal);
+		dhara_map_cache_flush(m);
+		cache_put(m, s, DHARA_PAGE_NONE);
 		return 0;
 	}
 
@@ -465,6 +650,9 @@ static int try_delete(struct dhara_map *m, dhara_sector_t s,
 	if (dhara_journal_copy(&m->journal, alt_page, meta, err) < 0)
 		return -1;
 
+	/* The cousin moved to the root, s is gone */
+	cache_put(m, meta_get_id(alt_meta), dhara_journal_root(&m->journal));
+	cache_put(m, s, DHARA_PAGE_NONE);
 	m->count--;
 	return 0;
 }
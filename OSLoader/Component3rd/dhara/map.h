@@ -32,6 +32,22 @@ struct dhara_map {
 
 	uint8_t			gc_ratio;
 	dhara_sector_t		count;
+
+	/* Ratio actually applied by automatic collection, at most
+	 * gc_ratio. See dhara_map_set_gc_ratio().
+	 */
+	uint8_t			gc_write_ratio;
+
+	/* Optional sector -> page translation cache, see
+	 * dhara_map_cache_init(). With c_tag it is direct mapped over
+	 * c_size (a power of two) slots, without it c_page has one
+	 * entry per sector.
+	 */
+	dhara_page_t		*c_page;
+	dhara_sector_t		*c_tag;
+	dhara_sector_t		c_size;
+	uint32_t		c_hits;
+	uint32_t		c_misses;
 };
 
 /* Initialize a map. You need to supply a buffer for page metadata, and
@@ -45,11 +61,57 @@ struct dhara_map {
 void dhara_map_init(struct dhara_map *m, const struct dhara_nand *n,
 		    uint8_t *page_buf, uint8_t gc_ratio);
 
+/* Rewrite the given page at the front of the journal if it still
+ * holds the current copy of its sector, so that data read with many
+ * corrected bits is refreshed before it becomes uncorrectable. Stale
+ * and filler pages are left alone. Returns 0 on success or -1 if an
+ * error occurs.
+ */
+int dhara_map_refresh(struct dhara_map *m, dhara_page_t src,
+		      dhara_error_t *err);
+
+/* Lower the garbage collection ratio used by automatic collection
+ * below the one given to dhara_map_init(), trading the reserve for
+ * shorter writes. The missing work is expected from dhara_map_gc()
+ * calls made while the system is idle. Once half of the reserve is
+ * used up, writes fall back to the full ratio. The capacity is not
+ * affected.
+ */
+void dhara_map_set_gc_ratio(struct dhara_map *m, uint8_t ratio);
+
+/* Return non-zero if fewer than the given number of pages can be
+ * written before automatic garbage collection starts.
+ */
+int dhara_map_gc_wanted(const struct dhara_map *m, dhara_page_t headroom);
+
+/* Attach a RAM translation cache so that lookups don't have to walk the
+ * radix tree in flash. Writes, trims and garbage collection keep it
+ * coherent.
+ *
+ * If tag is non-NULL, page and tag are arrays of size slots (which must
+ * be a power of two) and the cache is direct mapped. If tag is NULL,
+ * page must hold one entry per sector of capacity (full map). Pass a
+ * NULL page to detach the cache.
+ */
+void dhara_map_cache_init(struct dhara_map *m, dhara_page_t *page,
+			  dhara_sector_t *tag, dhara_sector_t slots);
+
+/* Forget every cached translation. */
+void dhara_map_cache_flush(struct dhara_map *m);
+
 /* Recover stored state, if possible. If there is no valid stored state
  * on the chip, -1 is returned, and an empty map is initialized.
  */
 int dhara_map_resume(struct dhara_map *m, dhara_error_t *err);
 
+/* Recover stored state from a checkpoint recorded after an earlier
+ * dhara_map_sync(), see dhara_journal_restore(). On failure an empty
+ * map is initialized and the caller should fall back to
+ * dhara_map_resume().
+ */
+int dhara_map_restore(struct dhara_map *m, dhara_page_t root,
+		      uint8_t epoch, dhara_error_t *err);
+
 /* Clear the map (delete all sectors). */
 void dhara_map_clear(struct dhara_map *m);
 
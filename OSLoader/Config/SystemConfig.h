@@ -37,6 +37,33 @@
     #define MINILZO  1      // 2 KB Work Buffer
     #define QUICKLZ  2      // 60 KB Work buffer
     #define MEM_COMPRESSION_ALGORITHM     (MINILZO) //algorithm
+    #define VM_ZRAM_RAW_THRESHOLD         (PAGE_SIZE * 7 / 8)  // pages compressing worse are stored raw
+    #define VM_ZRAM_ESTIMATE_SAMPLES      (128)
+    #define VM_ZRAM_ESTIMATE_DISTINCT     (90)  // distinct sampled bytes above which LZO is skipped
+    #define VM_ZRAM_COMPACT_MIN_FREE      (PAGE_SIZE * 2)  // compact ZRAM when the largest free block gets smaller
+
+    // VRAM pages beyond ZRAM go to a log of packed sectors at the start of the FTL swap area.
+    #define VM_SWAP_PAGES                 ((VM_RAM_SIZE - ZRAM_COMPRESSED_SIZE) / PAGE_SIZE)
+    #define VM_SWAP_LOG_START             (0)
+    #define VM_SWAP_LOG_SECTORS           (3072)  // must stay above VM_SWAP_PAGES, up to FLASH_FTL_DATA_SECTOR
+
+    #define VM_POLICY_FIFO   0
+    #define VM_POLICY_CLOCK  1
+    #define VM_POLICY_2Q     2
+    #define VM_REPLACE_POLICY_VROM        (VM_POLICY_CLOCK)
+    #define VM_REPLACE_POLICY_VRAM        (VM_POLICY_2Q)
+
+    #define VM_WRITEBACK_ENABLE           (1)
+    #define VM_WRITEBACK_WINDOW           (8)   // eviction candidates kept clean by the writeback task
+    #define VM_WRITEBACK_PERIOD_MS        (20)
+
+    #define VM_READAHEAD_MAX_PAGES        (4)   // VROM read-ahead window limit for sequential faults
+    #define VM_FAULT_AROUND_PAGES         (3)   // VRAM pages after a fault mapped from ZRAM in the same pass
+    #define VM_PREFETCH_MAX_PAGES         (NUM_CACHEPAGE_VROM / 4)  // per LL_FAST_SWI_MEM_PREFETCH hint
+
+    // Fully resident VROM regions are mapped as one small (4) or large (64) page, 0 keeps tiny pages only.
+    // A large page needs 64 aligned frames of the VROM cache, at most two fit.
+    #define VM_PROMOTE_PAGES              (4)
 #endif
 
 #define TOTAL_MEM_PAGE  (292)
@@ -85,6 +112,11 @@
 
 
 
+// Buckets of the vaddr -> cache page hash, must be power of 2
+#define VM_CACHE_HASH_BUCKETS           (128)
+#define VM_CACHE_HASH_BUCKETS_VROM      (64)
+#define VM_CACHE_HASH_BUCKETS_VRAM      (32)
+
 #if USE_TINY_PAGE
     #define PAGE_SIZE           (1024)
 #else
@@ -134,10 +166,12 @@
 // edb writes pages 16 by 16 (32K)
 #define FLASH_LOADER_BLOCK      22 // page 22*64=1408 (*2K)
 #define FLASH_CONFIG_BLOCK      23
+#define FLASH_MOUNT_BLOCK       30 // last block before the system, OSLoader.sb must end below it (checked in ldr_ld.script)
 #define FLASH_SYSTEM_BLOCK      31 // page 31*64=1984 (*2K)
 #define FLASH_DATA_BLOCK        160 // page 10240 (*2K), also named DATA_START_BLOCK 
 
 #define FLASH_FTL_DATA_SECTOR   4096    //8MB Start
+#define LLAPI_FLASH_BOUNCE_PAGES    (2)     // sectors per FTL request when a flash SWI buffer is not DMA-able
 
 #define MSC_CONF_OSLOADER_EDB   0
 #define MSC_CONF_SYS_DATA       1
@@ -1,3 +1,5 @@
+#include <stddef.h>
+
 #include "FTL_up.h"
 #include "../debug.h"
 #include "mtd_up.h"
@@ -5,13 +7,34 @@
 static mtdInfo_t *pMtdinfo;
 
 static uint8_t PageBuffer[2048] __attribute__((aligned(4)));
-//static uint8_t CopyBuffer[2048] __attribute__((aligned(4)));
+#if !FTL_USE_COPY_PAGE
+static uint8_t CopyBuffer[2048] __attribute__((aligned(4)));
+#endif
 
 static struct dhara_nand nandDevice;
 static struct dhara_map FTLmap;
+static dhara_page_t MapCachePage[FTL_MAP_CACHE_SLOTS];
+static dhara_sector_t MapCacheTag[FTL_MAP_CACHE_SLOTS];
+#if FTL_MAP_CACHE_FULL
+static dhara_page_t *MapFull;
+#endif
+#include "regsdigctl.h"
+
+// Inline GC ratio of writes to the VM swap area and to the system data area.
+static uint8_t FTL_GCRatio[FTL_GC_PARTS] = {FTL_GC_RATIO_SWAP, FTL_GC_RATIO_DATA};
+static volatile bool FTL_SystemIdle = false;
+
+uint32_t g_ftl_idle_gc_cnt = 0;
+uint32_t g_ftl_copy_cnt = 0;
+uint32_t g_ftl_sector_writes = 0;
+uint32_t g_ftl_wcache_absorbed = 0;
+uint32_t g_ftl_scrub_cnt = 0;
+uint32_t g_ftl_scrub_raw = 0;
+uint32_t g_ftl_copy_us = 0;
+uint32_t g_ftl_wlat_hist[FTL_WLAT_BUCKETS];
+
 //#define PR_FTL_TIMING_STATUS
 #ifdef PR_FTL_TIMING_STATUS
-#include "regsdigctl.h"
 static uint32_t ftl_rdt;
 static uint32_t ftl_wrt;
 #endif
@@ -38,22 +61,169 @@ static int _log2(int x) // log2(x)
     return res;
 }
 
+static FTL_WearTable_t WearTab;
+static bool WearTabDirty = false;
+static uint32_t WearMigrated = 0;
+static bool WearUneven = false;
+
+#if FTL_MOUNT_BLOCK
+// Mount records are appended to FTL_MOUNT_BLOCK, the last programmed page wins.
+// A clean record is only valid until the journal changes, so the first NAND
+// write after it is preceded by a dirty one.
+static uint32_t MountNext;      // next free page in the block
+static uint32_t MountSeq;
+static bool MountClean = false;
+static bool MountOff = false;
+#endif
+extern uint32_t g_mtd_read_cnt;
+uint32_t g_ftl_mount_us = 0;
+uint32_t g_ftl_mount_reads = 0;
+bool g_ftl_mount_fast = false;
+
+// Bad block state learnt from the block metadata, kept across boots in the mount record.
+#define BBT_TEST(t, b)      ((t)[(b) / 32] & (1UL << ((b) & 31)))
+#define BBT_SET(t, b)       ((t)[(b) / 32] |= (1UL << ((b) & 31)))
+static uint32_t BbtKnown[FTL_BBT_WORDS];
+static uint32_t BbtBad[FTL_BBT_WORDS];
+uint32_t g_ftl_bbt_hits = 0;
+
+#if FTL_MOUNT_BLOCK
+static uint32_t FTL_Crc32(const uint8_t *p, uint32_t len) {
+    uint32_t crc = 0xFFFFFFFF;
+    while (len--) {
+        crc ^= *p++;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+static void FTL_MountWrite(bool clean) {
+    uint32_t base = FTL_MOUNT_BLOCK * pMtdinfo->PagesPerBlock;
+    uint32_t metadata = DATA_BLOCK;
+    FTL_MountRecord_t *rec;
+    uint8_t *buf;
+
+    if (MountOff) {
+        return;
+    }
+    if (MountNext >= pMtdinfo->PagesPerBlock) {
+        if (MTD_ErasePhyBlock(FTL_MOUNT_BLOCK)) {
+            FTL_WARN("MOUNT BLOCK ERASE FAIL\n");
+            MountOff = true;
+            return;
+        }
+        MountNext = 0;
+    }
+
+    // PageBuffer holds the journal's pending metadata once dhara is up.
+    buf = pvPortMalloc(pMtdinfo->PageSize_B);
+    if (!buf) {
+        FTL_WARN("MOUNT RECORD NO MEMORY\n");
+        if (!clean) {
+            MountOff = (MTD_ErasePhyBlock(FTL_MOUNT_BLOCK) != 0);
+            MountNext = 0;
+        }
+        return;
+    }
+    memset(buf, 0xFF, pMtdinfo->PageSize_B);
+    rec = (FTL_MountRecord_t *)buf;
+    rec->magic = FTL_MOUNT_MAGIC;
+    rec->seq = ++MountSeq;
+    rec->clean = clean;
+    rec->blocks = nandDevice.num_blocks;
+    rec->epoch = FTLmap.journal.epoch;
+    rec->root = dhara_journal_root(&FTLmap.journal);
+    rec->head = FTLmap.journal.head;
+    rec->count = FTLmap.count;
+    memcpy(rec->bbtKnown, BbtKnown, sizeof(BbtKnown));
+    memcpy(rec->bbtBad, BbtBad, sizeof(BbtBad));
+    rec->crc = FTL_Crc32(buf, offsetof(FTL_MountRecord_t, crc));
+
+    if (MTD_WritePhyPageWithMeta(base + MountNext++, 4, buf, (uint8_t *)&metadata)) {
+        // A dirty record must not leave the previous clean one in charge.
+        FTL_WARN("MOUNT RECORD WRITE FAIL\n");
+        if (!clean) {
+            MountOff = (MTD_ErasePhyBlock(FTL_MOUNT_BLOCK) != 0);
+            MountNext = 0;
+        }
+    }
+    vPortFree(buf);
+}
+
+static inline void FTL_MountDirty() {
+    if (MountClean) {
+        MountClean = false;
+        FTL_MountWrite(false);
+    }
+}
+
+// Find the last record, pages are programmed in order so the boundary is bisected.
+static bool FTL_MountLoad(FTL_MountRecord_t *out) {
+    uint32_t base = FTL_MOUNT_BLOCK * pMtdinfo->PagesPerBlock;
+    uint32_t lo = 0, hi = pMtdinfo->PagesPerBlock;
+    FTL_MountRecord_t *rec = (FTL_MountRecord_t *)PageBuffer;
+
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (MTD_ReadPhyPage(base + mid, 0, pMtdinfo->PageSize_B, PageBuffer) == 1) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    MountNext = lo;
+    if (lo == 0) {
+        return false;
+    }
+    if ((MTD_ReadPhyPage(base + lo - 1, 0, pMtdinfo->PageSize_B, PageBuffer) < 0) ||
+        (rec->magic != FTL_MOUNT_MAGIC) || (rec->crc != FTL_Crc32(PageBuffer, offsetof(FTL_MountRecord_t, crc)))) {
+        return false;
+    }
+    MountSeq = rec->seq;
+    memcpy(out, rec, sizeof(FTL_MountRecord_t));
+    return out->clean && (out->blocks == nandDevice.num_blocks);
+}
+#endif
+
 uint32_t meta;
 int dhara_nand_is_bad(const struct dhara_nand *n, dhara_block_t b) {
     uint32_t ret;
+    if ((b < FTL_WEAR_MAX_BLOCKS) && BBT_TEST(BbtKnown, b)) {
+        g_ftl_bbt_hits++;
+        return BBT_TEST(BbtBad, b) ? 1 : 0;
+    }
     ret = MTD_ReadPhyPageMeta((DATA_START_BLOCK + b) * pMtdinfo->PagesPerBlock, 4, (uint8_t *)&meta);
     // printf("TEST BAD\n");
     if ((ret == -1) || (meta == BAD_BLOCK)) {
 
         printf("Found BAD Block:%lu\n", DATA_START_BLOCK + b);
+        if (b < FTL_WEAR_MAX_BLOCKS) {
+            WearTab.cnt[b] = FTL_WEAR_BAD;
+            // An unreadable marker is asked again next time.
+            if (ret != -1) {
+                BBT_SET(BbtKnown, b);
+                BBT_SET(BbtBad, b);
+            }
+        }
         return 1;
     }
+    if (b < FTL_WEAR_MAX_BLOCKS) {
+        BBT_SET(BbtKnown, b);
+    }
     return 0;
 }
 
 void dhara_nand_mark_bad(const struct dhara_nand *n, dhara_block_t b) {
     meta = BAD_BLOCK;
     printf("MARK BAD BLOCK\n");
+    if (b < FTL_WEAR_MAX_BLOCKS) {
+        WearTab.cnt[b] = FTL_WEAR_BAD;
+        WearTabDirty = true;
+        BBT_SET(BbtKnown, b);
+        BBT_SET(BbtBad, b);
+    }
     uint8_t *tempbuf = pvPortMalloc(2048);
     uint8_t *tempmeta = pvPortMalloc(19);
     MTD_ReadPhyPage((DATA_START_BLOCK + b) * pMtdinfo->PagesPerBlock, 0, 2048, tempbuf);
@@ -68,8 +238,15 @@ void dhara_nand_mark_bad(const struct dhara_nand *n, dhara_block_t b) {
 int dhara_nand_erase(const struct dhara_nand *n, dhara_block_t b,
                      dhara_error_t *err) {
     int ret;
+#if FTL_MOUNT_BLOCK
+    FTL_MountDirty();
+#endif
     ret = MTD_ErasePhyBlock(DATA_START_BLOCK + b);
     // printf("ERASE ret %d, block:%d\n",ret,b);
+    if ((b < FTL_WEAR_MAX_BLOCKS) && (WearTab.cnt[b] < FTL_WEAR_BAD - 1)) {
+        WearTab.cnt[b]++;
+        WearTabDirty = true;
+    }
     *err = DHARA_E_NONE;
     if (ret) {
         *err = DHARA_E_BAD_BLOCK;
@@ -83,6 +260,9 @@ int dhara_nand_prog(const struct dhara_nand *n, dhara_page_t p,
                     dhara_error_t *err) {
     int ret;
     uint32_t metadata = DATA_BLOCK;
+#if FTL_MOUNT_BLOCK
+    FTL_MountDirty();
+#endif
     // printf("PROG page:%d, data:%p\n",p, data);
     // ret = MTD_WritePhyPage(p + (DATA_START_BLOCK *  pMtdinfo->PagesPerBlock) , (uint8_t *)data);
     ret = MTD_WritePhyPageWithMeta(
@@ -103,7 +283,13 @@ int dhara_nand_prog(const struct dhara_nand *n, dhara_page_t p,
 
 int dhara_nand_is_free(const struct dhara_nand *n, dhara_page_t p) {
     int ret;
+#if MTD_META_ONLY_READ
+    // Every programmed page carries DATA_BLOCK in its metadata, an erased aux block is enough.
+    uint32_t m;
+    ret = MTD_ReadPhyPageMeta(p + (DATA_START_BLOCK * pMtdinfo->PagesPerBlock), 4, (uint8_t *)&m);
+#else
     ret = MTD_ReadPhyPage(p + (DATA_START_BLOCK * pMtdinfo->PagesPerBlock), 0, _pow(2, n->log2_page_size), NULL);
+#endif
     // printf("is_free %d\n",ret);
     return (ret == 1);
 }
@@ -135,15 +321,23 @@ int dhara_nand_copy(const struct dhara_nand *n,
                     dhara_page_t src, dhara_page_t dst,
                     dhara_error_t *err) {
     int ret = 0;
+    uint32_t t0 = HW_DIGCTL_MICROSECONDS_RD();
+#if FTL_MOUNT_BLOCK
+    FTL_MountDirty();
+#endif
     // printf("COPY SRC %d dst %d\n",src,dst);
-    /*
-    ret = MTD_CopyPhyPage(src + (DATA_START_BLOCK *  pMtdinfo->PagesPerBlock),
-                          dst + (DATA_START_BLOCK *  pMtdinfo->PagesPerBlock));*/
-
-    uint8_t *CopyBuffer = pvPortMalloc(2048);
 
     *err = DHARA_E_NONE;
 
+#if FTL_USE_COPY_PAGE
+    ret = MTD_CopyPhyPage(src + (DATA_START_BLOCK * pMtdinfo->PagesPerBlock),
+                          dst + (DATA_START_BLOCK * pMtdinfo->PagesPerBlock));
+    if (ret < 0) {
+        *err = DHARA_E_ECC;
+        printf("COPY RD ERR\n");
+        return -1;
+    }
+#else
     ret = MTD_ReadPhyPage(src + (DATA_START_BLOCK * pMtdinfo->PagesPerBlock), 0, pMtdinfo->PageSize_B, (uint8_t *)CopyBuffer);
     if (ret < 0) {
         *err = DHARA_E_ECC;
@@ -151,15 +345,17 @@ int dhara_nand_copy(const struct dhara_nand *n,
         return -1;
     }
     ret = MTD_WritePhyPage(dst + (DATA_START_BLOCK * pMtdinfo->PagesPerBlock), (uint8_t *)CopyBuffer);
+#endif
 
     if (ret) {
         *err = DHARA_E_BAD_BLOCK;
         printf("COPY WR ERR\n");
+        return -1;
     }
 
-    vPortFree(CopyBuffer);
-
-    return ret;
+    g_ftl_copy_cnt++;
+    g_ftl_copy_us += HW_DIGCTL_MICROSECONDS_RD() - t0;
+    return 0;
 }
 
 //===================================================================================
@@ -174,6 +370,10 @@ static QueueHandle_t FTL_Operates_Queue;
 
 static bool inited = false;
 
+#if FTL_WCACHE_SLOTS
+static void wcache_invalidate(void);
+#endif
+
 static uint32_t max_ftl_pages;
 
 static FTL_Operates curOpa;
@@ -185,18 +385,88 @@ bool FTL_inited() {
 char *testdat;
 
 void FTL_ClearAllSector() {
+    WearTabDirty = true;
+#if FTL_WCACHE_SLOTS
+    wcache_invalidate();
+#endif
     dhara_map_clear(&FTLmap);
 }
 
+static void FTL_WearLoad() {
+    dhara_error_t err;
+    FTL_WearStats_t st;
+    uint32_t blocks = nandDevice.num_blocks < FTL_WEAR_MAX_BLOCKS ? nandDevice.num_blocks : FTL_WEAR_MAX_BLOCKS;
+
+    if ((dhara_map_read(&FTLmap, FTL_WEAR_SECTOR, (uint8_t *)&WearTab, &err) < 0) ||
+        (WearTab.magic != FTL_WEAR_MAGIC) || (WearTab.blocks != blocks)) {
+        INFO("No wear table, counting from zero.\n");
+        memset(&WearTab, 0, sizeof(WearTab));
+        WearTab.magic = FTL_WEAR_MAGIC;
+        WearTab.blocks = blocks;
+        WearTabDirty = true;
+    }
+    // Blocks found bad while mounting were marked before the table was loaded
+    // over them, and the cached bad block table will not report them again.
+    for (uint32_t b = 0; b < blocks; b++) {
+        if (BBT_TEST(BbtBad, b) && (WearTab.cnt[b] != FTL_WEAR_BAD)) {
+            WearTab.cnt[b] = FTL_WEAR_BAD;
+            WearTabDirty = true;
+        }
+    }
+    FTL_GetWearStats(&st);
+    WearUneven = (st.max - st.min > FTL_WL_SPREAD_MAX);
+}
+
 int FTL_MapInit() {
     dhara_error_t err;
-    int ret;
+    int ret = -1;
+    uint32_t t0 = HW_DIGCTL_MICROSECONDS_RD();
+    uint32_t r0 = g_mtd_read_cnt;
     dhara_map_init(&FTLmap, &nandDevice, PageBuffer, GC_RATIO);
+    memset(BbtKnown, 0, sizeof(BbtKnown));
+    memset(BbtBad, 0, sizeof(BbtBad));
+#if FTL_WCACHE_SLOTS
+    wcache_invalidate();
+#endif
     err = 0;
-    ret = dhara_map_resume(&FTLmap, &err);
-    INFO("Resume FTL: %d\n", ret);
+    g_ftl_mount_fast = false;
+#if FTL_MOUNT_BLOCK
+    {
+        // Too large for the FTL task stack under the resume call chain.
+        static FTL_MountRecord_t rec;
+        MountClean = false;
+        if (FTL_MountLoad(&rec)) {
+            // The found head and count must agree with the record, otherwise
+            // something was written after it and the full scan decides.
+            ret = dhara_map_restore(&FTLmap, rec.root, rec.epoch, &err);
+            g_ftl_mount_fast = (ret == 0) && (FTLmap.journal.head == rec.head) && (FTLmap.count == rec.count);
+            MountClean = g_ftl_mount_fast;
+            if (g_ftl_mount_fast) {
+                memcpy(BbtKnown, rec.bbtKnown, sizeof(BbtKnown));
+                memcpy(BbtBad, rec.bbtBad, sizeof(BbtBad));
+            }
+        }
+    }
+#endif
+    if (!g_ftl_mount_fast) {
+        ret = dhara_map_resume(&FTLmap, &err);
+    }
+    g_ftl_mount_us = HW_DIGCTL_MICROSECONDS_RD() - t0;
+    g_ftl_mount_reads = g_mtd_read_cnt - r0;
+    INFO("Resume FTL: %d (%s, %ld us, %ld reads)\n", ret, g_ftl_mount_fast ? "record" : "scan", g_ftl_mount_us, g_ftl_mount_reads);
 
     max_ftl_pages = dhara_map_capacity(&FTLmap);
+
+    dhara_map_cache_init(&FTLmap, MapCachePage, MapCacheTag, FTL_MAP_CACHE_SLOTS);
+#if FTL_MAP_CACHE_FULL
+    if (MapFull == NULL) {
+        MapFull = pvPortMalloc(max_ftl_pages * sizeof(dhara_page_t));
+    }
+    if (MapFull) {
+        dhara_map_cache_init(&FTLmap, MapFull, NULL, max_ftl_pages);
+    }
+#endif
+    FTL_WearLoad();
     INFO("FTL capacity %ld/%ld (%ld K/ %ld K)\n", dhara_map_size(&FTLmap), max_ftl_pages, dhara_map_size(&FTLmap) * pMtdinfo->PageSize_B / 1024, dhara_map_capacity(&FTLmap) * pMtdinfo->PageSize_B / 1024);
 
     return ret;
@@ -241,43 +511,406 @@ int FTL_init() {
     return ret;
 }
 
+// Sectors whose pages follow each other on flash are fetched with one MTD request.
+static int FTL_ReadSectors(uint32_t sector, uint32_t num, uint8_t *buf) {
+    dhara_error_t err;
+    dhara_page_t p, run_page = 0;
+    uint32_t run = 0;
+    uint8_t *run_buf = buf;
+    int ret;
+
+    for (uint32_t i = 0; i <= num; i++, buf += pMtdinfo->PageSize_B) {
+        p = DHARA_PAGE_NONE;
+        if (i < num) {
+            if (dhara_map_find(&FTLmap, sector + i, &p, &err) < 0) {
+                if (err != DHARA_E_NOT_FOUND) {
+                    FTL_WARN("FTL READ FAIL:%s\n", dhara_strerror(err));
+                    return -1;
+                }
+                memset(buf, 0xFF, pMtdinfo->PageSize_B);
+            }
+        }
+        if (run && ((p != run_page + run) || (run >= FTL_READ_RUN_MAX))) {
+            ret = MTD_ReadPhyPages(run_page + (DATA_START_BLOCK * pMtdinfo->PagesPerBlock), run, run_buf);
+            if (ret < 0) {
+                FTL_WARN("FTL READ FAIL:%d\n", ret);
+                return ret;
+            }
+            run = 0;
+        }
+        if (p != DHARA_PAGE_NONE) {
+            if (run == 0) {
+                run_page = p;
+                run_buf = buf;
+            }
+            run++;
+        }
+    }
+    return 0;
+}
+
+static void FTL_RecordWriteLatency(uint32_t us) {
+    uint32_t b = 0;
+    while ((b < FTL_WLAT_BUCKETS - 1) && (us >= ((uint32_t)FTL_WLAT_BUCKET0_US << b))) {
+        b++;
+    }
+    g_ftl_wlat_hist[b]++;
+}
+
+// Upper bound in us of the bucket holding the given per mille of sector writes.
+uint32_t FTL_GetWriteLatency(uint32_t permille) {
+    uint32_t total = 0, acc = 0;
+    for (int b = 0; b < FTL_WLAT_BUCKETS; b++) {
+        total += g_ftl_wlat_hist[b];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    for (int b = 0; b < FTL_WLAT_BUCKETS; b++) {
+        acc += g_ftl_wlat_hist[b];
+        if (acc * 1000 >= total * permille) {
+            return (uint32_t)FTL_WLAT_BUCKET0_US << b;
+        }
+    }
+    return (uint32_t)FTL_WLAT_BUCKET0_US << (FTL_WLAT_BUCKETS - 1);
+}
+
+void FTL_SetGCRatio(uint32_t part, uint8_t ratio) {
+    if (part < FTL_GC_PARTS) {
+        FTL_GCRatio[part] = ratio > GC_RATIO ? GC_RATIO : ratio;
+    }
+}
+
+// Called from the idle hook and LL_FAST_SWI_SYSTEM_IDLE, cleared by the next FTL request.
+void FTL_NotifyIdle() {
+    FTL_SystemIdle = true;
+}
+
+// Collecting a live page does not shrink the journal, so a map that is nearly
+// full of live sectors keeps gc_wanted set forever. Only run while at least a
+// checkpoint group worth of pages is garbage.
+static bool FTL_IdleGCWanted() {
+    dhara_page_t size = dhara_journal_size(&FTLmap.journal);
+    dhara_page_t meta = size >> FTLmap.journal.log2_ppc;
+
+    if (!dhara_map_gc_wanted(&FTLmap, FTL_IDLE_GC_HEADROOM)) {
+        return false;
+    }
+    return size > dhara_map_size(&FTLmap) + meta + (1 << FTLmap.journal.log2_ppc);
+}
+
+// Poll for idle time only while collection would otherwise soon run inline.
+static TickType_t FTL_IdleGCWait() {
+    if (FTL_inited() && FTL_IdleGCWanted()) {
+        return pdMS_TO_TICKS(FTL_IDLE_GC_PERIOD_MS);
+    }
+    return portMAX_DELAY;
+}
+
+static void FTL_IdleGC() {
+    dhara_error_t err;
+
+    if (!FTL_SystemIdle) {
+        return;
+    }
+    for (int i = 0; (i < FTL_IDLE_GC_SLICE) && FTL_IdleGCWanted(); i++) {
+        if (dhara_map_gc(&FTLmap, &err) < 0) {
+            FTL_WARN("FTL IDLE GC FAIL:%s\n", dhara_strerror(err));
+            break;
+        }
+        g_ftl_idle_gc_cnt++;
+    }
+}
+
+void FTL_GetWearStats(FTL_WearStats_t *st) {
+    uint64_t sum = 0;
+    uint32_t good = 0;
+
+    memset(st, 0, sizeof(FTL_WearStats_t));
+    st->min = 0xFFFFFFFF;
+    for (uint32_t b = 0; b < WearTab.blocks; b++) {
+        if ((WearTab.cnt[b] == FTL_WEAR_BAD) || BBT_TEST(BbtBad, b)) {
+            st->bad++;
+            continue;
+        }
+        if (WearTab.cnt[b] < st->min) {
+            st->min = WearTab.cnt[b];
+            st->minBlock = b;
+        }
+        if (WearTab.cnt[b] > st->max) {
+            st->max = WearTab.cnt[b];
+            st->maxBlock = b;
+        }
+        sum += WearTab.cnt[b];
+        good++;
+    }
+    if (good == 0) {
+        st->min = 0;
+    } else {
+        st->avg = sum / good;
+    }
+    st->migrated = WearMigrated;
+}
+
+uint32_t FTL_GetEraseCount(uint32_t block) {
+    return block < WearTab.blocks ? WearTab.cnt[block] : 0;
+}
+
+uint32_t FTL_GetWearBlocks() {
+    return WearTab.blocks;
+}
+
+// The journal recycles blocks in order, so the spread stays small unless a block
+// keeps cold data through many rotations. Then collect from the tail until the
+// least worn block has been left behind, it is erased again once the head gets there.
+static void FTL_WearLevel() {
+    FTL_WearStats_t st;
+    dhara_error_t err;
+    const struct dhara_journal *j = &FTLmap.journal;
+    uint32_t tailBlk, headBlk;
+    bool live;
+
+    if (!WearUneven || !FTL_SystemIdle) {
+        return;
+    }
+    FTL_GetWearStats(&st);
+    WearUneven = (st.max - st.min > FTL_WL_SPREAD_MAX);
+    if (!WearUneven) {
+        return;
+    }
+    for (int i = 0; i < FTL_IDLE_GC_SLICE; i++) {
+        tailBlk = j->tail >> nandDevice.log2_ppb;
+        headBlk = j->head >> nandDevice.log2_ppb;
+        live = (tailBlk <= headBlk) ? ((st.minBlock >= tailBlk) && (st.minBlock <= headBlk))
+                                    : ((st.minBlock >= tailBlk) || (st.minBlock <= headBlk));
+        if (!live || (st.minBlock == headBlk) || !FTLmap.count) {
+            return;
+        }
+        if (dhara_map_gc(&FTLmap, &err) < 0) {
+            FTL_WARN("FTL WL FAIL:%s\n", dhara_strerror(err));
+            return;
+        }
+        WearMigrated++;
+    }
+}
+
+// Refresh pages the MTD layer saw with many corrected bits. FTL pages are rewritten
+// at the journal head, raw flash pages (loader, System image) are only reported:
+// rewriting them in place would put the whole block at risk on a power loss.
+static void FTL_Scrub() {
+    dhara_error_t err;
+    uint32_t page;
+    uint32_t base = DATA_START_BLOCK * pMtdinfo->PagesPerBlock;
+
+    for (int i = 0; (i < FTL_IDLE_GC_SLICE) && FTL_SystemIdle; i++) {
+        // Leave room for the rewrite without running inline GC.
+        if (dhara_map_gc_wanted(&FTLmap, 1) || !MTD_GetScrubPage(&page)) {
+            return;
+        }
+        if (page < base) {
+            g_ftl_scrub_raw++;
+            FTL_WARN("SCRUB: raw page %ld is wearing out\n", page);
+            continue;
+        }
+        if (dhara_map_refresh(&FTLmap, page - base, &err) < 0) {
+            FTL_WARN("SCRUB FAIL:%ld,%s\n", page, dhara_strerror(err));
+            continue;
+        }
+        g_ftl_scrub_cnt++;
+    }
+}
+
+static int FTL_WriteOne(uint32_t sector, const uint8_t *buf) {
+    dhara_error_t err;
+    uint32_t t0;
+    int ret;
+
+    #ifdef PR_FTL_TIMING_STATUS
+    ftl_wrt = HW_DIGCTL_MICROSECONDS_RD();
+    #endif
+    dhara_map_set_gc_ratio(&FTLmap, FTL_GCRatio[sector < FLASH_FTL_DATA_SECTOR ? FTL_GC_PART_SWAP : FTL_GC_PART_DATA]);
+    t0 = HW_DIGCTL_MICROSECONDS_RD();
+    ret = dhara_map_write(&FTLmap, sector, buf, &err);
+    FTL_RecordWriteLatency(HW_DIGCTL_MICROSECONDS_RD() - t0);
+    #ifdef PR_FTL_TIMING_STATUS
+    INFO("fwr=%ld\n",HW_DIGCTL_MICROSECONDS_RD() - ftl_wrt);
+    #endif
+    g_ftl_sector_writes++;
+    if (ret) {
+        FTL_WARN("FTL WRITE FAIL:%d,%s\n", ret, dhara_strerror(err));
+    }
+    return ret;
+}
+
+#if FTL_WCACHE_SLOTS
+// Single sector writes (FAT and directory updates mostly) are kept here and
+// rewrites of the same sector only replace the RAM copy. Dirty slots reach
+// dhara on eviction, on FTL_Sync() and FTL_WCACHE_FLUSH_MS after their first
+// write. Unsynced dhara writes can be lost on power failure anyway, the cache
+// only widens that window by the flush period.
+static uint32_t WCacheData[FTL_WCACHE_SLOTS][2048 / sizeof(uint32_t)];
+static FTL_WCacheSlot_t WCache[FTL_WCACHE_SLOTS];
+static uint32_t WCacheClock;
+static uint32_t WCacheDirty;
+
+static FTL_WCacheSlot_t *wcache_find(uint32_t sector) {
+    for (int i = 0; i < FTL_WCACHE_SLOTS; i++) {
+        if (WCache[i].sector == sector) {
+            return &WCache[i];
+        }
+    }
+    return NULL;
+}
+
+static int wcache_flush_slot(FTL_WCacheSlot_t *slot) {
+    int ret;
+    if (!slot->dirty) {
+        return 0;
+    }
+    ret = FTL_WriteOne(slot->sector, (uint8_t *)WCacheData[slot - WCache]);
+    if (ret == 0) {
+        slot->dirty = false;
+        WCacheDirty--;
+    }
+    return ret;
+}
+
+static void wcache_drop(FTL_WCacheSlot_t *slot) {
+    if (slot->dirty) {
+        WCacheDirty--;
+    }
+    slot->dirty = false;
+    slot->sector = FTL_WCACHE_NONE;
+}
+
+static int wcache_flush(bool expiredOnly) {
+    TickType_t now = xTaskGetTickCount();
+    int ret = 0;
+    for (int i = 0; i < FTL_WCACHE_SLOTS; i++) {
+        if (WCache[i].dirty && (!expiredOnly || (now - WCache[i].stamp >= pdMS_TO_TICKS(FTL_WCACHE_FLUSH_MS)))) {
+            if (wcache_flush_slot(&WCache[i])) {
+                ret = -1;
+            }
+        }
+    }
+    return ret;
+}
+
+static int wcache_write(uint32_t sector, const uint8_t *buf) {
+    FTL_WCacheSlot_t *slot = wcache_find(sector);
+    FTL_WCacheSlot_t *victim = NULL;
+
+    if (slot) {
+        if (slot->dirty) {
+            g_ftl_wcache_absorbed++;
+        }
+    } else {
+        // Unused slot first, then the least recently written clean one, then the least recently written dirty one.
+        for (int i = 0; i < FTL_WCACHE_SLOTS; i++) {
+            slot = &WCache[i];
+            if (slot->sector == FTL_WCACHE_NONE) {
+                victim = slot;
+                break;
+            }
+            if ((victim == NULL) || (victim->dirty && !slot->dirty) ||
+                ((victim->dirty == slot->dirty) && (slot->lru < victim->lru))) {
+                victim = slot;
+            }
+        }
+        slot = victim;
+        if (wcache_flush_slot(slot)) {
+            return -1;
+        }
+        slot->sector = sector;
+    }
+    if (!slot->dirty) {
+        slot->dirty = true;
+        slot->stamp = xTaskGetTickCount();
+        WCacheDirty++;
+    }
+    slot->lru = ++WCacheClock;
+    memcpy(WCacheData[slot - WCache], buf, 2048);
+    return 0;
+}
+
+static void wcache_overlay(uint32_t sector, uint32_t num, uint8_t *buf) {
+    for (int i = 0; i < FTL_WCACHE_SLOTS; i++) {
+        if ((WCache[i].sector != FTL_WCACHE_NONE) && (WCache[i].sector - sector < num)) {
+            memcpy(buf + (WCache[i].sector - sector) * pMtdinfo->PageSize_B, WCacheData[i], 2048);
+        }
+    }
+}
+
+static void wcache_invalidate() {
+    for (int i = 0; i < FTL_WCACHE_SLOTS; i++) {
+        WCache[i].sector = FTL_WCACHE_NONE;
+        WCache[i].dirty = false;
+    }
+    WCacheDirty = 0;
+}
+#endif
+
+static TickType_t FTL_NextWait() {
+    TickType_t wait = (WearUneven || MTD_ScrubPending()) ? pdMS_TO_TICKS(FTL_IDLE_GC_PERIOD_MS) : FTL_IdleGCWait();
+#if FTL_WCACHE_SLOTS
+    if (WCacheDirty && (wait > pdMS_TO_TICKS(FTL_WCACHE_FLUSH_MS))) {
+        wait = pdMS_TO_TICKS(FTL_WCACHE_FLUSH_MS);
+    }
+#endif
+    return wait;
+}
+
 void FTL_task() {
     dhara_error_t err;
     int ret = 0;
     while (1) {
-        if (xQueueReceive(FTL_Operates_Queue, &curOpa, portMAX_DELAY) == pdTRUE) {
+        if (xQueueReceive(FTL_Operates_Queue, &curOpa, FTL_NextWait()) != pdTRUE) {
+#if FTL_WCACHE_SLOTS
+            wcache_flush(true);
+#endif
+            FTL_IdleGC();
+            FTL_Scrub();
+            FTL_WearLevel();
+        } else {
+            FTL_SystemIdle = false;
             switch (curOpa.opa) {
             case FTL_SECTOR_READ:
-                for (int i = 0; i < curOpa.num; i++) {
-                    #ifdef PR_FTL_TIMING_STATUS
-                    ftl_rdt = HW_DIGCTL_MICROSECONDS_RD();
-                    #endif
-                    ret = dhara_map_read(&FTLmap, curOpa.sector++, curOpa.buf, &err);
-                    #ifdef PR_FTL_TIMING_STATUS
-                    INFO("frd=%ld\n",HW_DIGCTL_MICROSECONDS_RD() - ftl_rdt);
-                    #endif
-                    curOpa.buf += pMtdinfo->PageSize_B;
-                    if (ret) {
-                        FTL_WARN("FTL READ FAIL:%d,%s\n", ret, dhara_strerror(err));
-                        break;
-                    }
+                #ifdef PR_FTL_TIMING_STATUS
+                ftl_rdt = HW_DIGCTL_MICROSECONDS_RD();
+                #endif
+                ret = FTL_ReadSectors(curOpa.sector, curOpa.num, curOpa.buf);
+#if FTL_WCACHE_SLOTS
+                if (ret == 0) {
+                    wcache_overlay(curOpa.sector, curOpa.num, curOpa.buf);
                 }
+#endif
+                #ifdef PR_FTL_TIMING_STATUS
+                INFO("frd=%ld\n",HW_DIGCTL_MICROSECONDS_RD() - ftl_rdt);
+                #endif
                 //*curOpa.StatusBuf = ret;
                 xTaskNotify(curOpa.task, ret, eSetValueWithOverwrite);
                 break;
 
             case FTL_SECTOR_WRITE:
+#if FTL_WCACHE_SLOTS
+                // The VM swap log writes whole sectors once, only the data area is cached.
+                if ((curOpa.num == 1) && (curOpa.sector >= FLASH_FTL_DATA_SECTOR)) {
+                    ret = wcache_write(curOpa.sector, curOpa.buf);
+                    xTaskNotify(curOpa.task, ret, eSetValueWithOverwrite);
+                    break;
+                }
+#endif
                 for (int i = 0; i < curOpa.num; i++) {
-                    #ifdef PR_FTL_TIMING_STATUS
-                    ftl_wrt = HW_DIGCTL_MICROSECONDS_RD();
-                    #endif
-                    ret = dhara_map_write(&FTLmap, curOpa.sector++, curOpa.buf, &err);
-                    #ifdef PR_FTL_TIMING_STATUS
-                    INFO("fwr=%ld\n",HW_DIGCTL_MICROSECONDS_RD() - ftl_wrt);
-                    #endif
+#if FTL_WCACHE_SLOTS
+                    // Superseded by this write.
+                    FTL_WCacheSlot_t *slot = wcache_find(curOpa.sector);
+                    if (slot) {
+                        wcache_drop(slot);
+                    }
+#endif
+                    ret = FTL_WriteOne(curOpa.sector++, curOpa.buf);
                     curOpa.buf += pMtdinfo->PageSize_B;
                     if (ret) {
-                        FTL_WARN("FTL WRITE FAIL:%d,%s\n", ret, dhara_strerror(err));
                         break;
                     }
                 }
@@ -287,16 +920,41 @@ void FTL_task() {
                 break;
 
             case FTL_SECTOR_TRIM:
+#if FTL_WCACHE_SLOTS
+                {
+                    FTL_WCacheSlot_t *slot = wcache_find(curOpa.sector);
+                    if (slot) {
+                        wcache_drop(slot);
+                    }
+                }
+#endif
                 ret = dhara_map_trim(&FTLmap, curOpa.sector, &err);
                 //*curOpa.StatusBuf = ret;
                 xTaskNotify(curOpa.task, ret, eSetValueWithOverwrite);
                 break;
 
             case FTL_SYNC:
+#if FTL_WCACHE_SLOTS
+                wcache_flush(false);
+#endif
+                if (WearTabDirty && (FTL_WriteOne(FTL_WEAR_SECTOR, (uint8_t *)&WearTab) == 0)) {
+                    FTL_WearStats_t st;
+                    FTL_GetWearStats(&st);
+                    WearUneven = (st.max - st.min > FTL_WL_SPREAD_MAX);
+                    WearTabDirty = false;
+                }
                 ret = dhara_map_sync(&FTLmap, &err);
                 if (ret) {
                     FTL_WARN("FTL SYNC FAIL:%d,%s\n", ret, dhara_strerror(err));
                 }
+#if FTL_MOUNT_BLOCK
+                // Not recorded when the head wrapped past the root, its epoch differs from the checkpoint's.
+                else if (!MountClean && (dhara_journal_root(&FTLmap.journal) != DHARA_PAGE_NONE) &&
+                         (FTLmap.journal.head > dhara_journal_root(&FTLmap.journal))) {
+                    FTL_MountWrite(true);
+                    MountClean = true;
+                }
+#endif
                 //*curOpa.StatusBuf = ret;
                 xTaskNotify(curOpa.task, ret, eSetValueWithOverwrite);
                 break;
@@ -318,6 +976,11 @@ int FTL_GetSectorSize() {
     return pMtdinfo->PageSize_B;
 }
 
+void FTL_GetMapCacheStats(uint32_t *hits, uint32_t *misses) {
+    *hits = FTLmap.c_hits;
+    *misses = FTLmap.c_misses;
+}
+
 int FTL_ReadSector(uint32_t sector, uint32_t num, uint8_t *buf) {
 
     FTL_Operates newOpa;
@@ -403,34 +1066,19 @@ int FTL_TrimSector(uint32_t sector) {
 }
 
 int FTL_Sync() {
-    //FTL_Operates newOpa;
-    dhara_error_t err;
-    int ret;
-
+    FTL_Operates newOpa;
     int retVal;
     if (!FTL_inited()) {
         return -1;
     }
 
-    ret = dhara_map_sync(&FTLmap, &err);
-    if (ret) {
-        FTL_WARN("FTL SYNC FAIL:%d,%s\n", ret, dhara_strerror(err));
-    }
+    // Runs in the FTL task so that cached sectors are written before the checkpoint.
+    newOpa.opa = FTL_SYNC;
+    newOpa.task = xTaskGetCurrentTaskHandle();
+    xTaskNotifyStateClear(NULL);
+    xQueueSend(FTL_Operates_Queue, &newOpa, portMAX_DELAY);
+    xTaskNotifyWait(0, 0xFFFFFFFF, (uint32_t *)&retVal, portMAX_DELAY);
     INFO("Sync.\n");
-    return ret;
-
-    /*
-        newOpa.opa = FTL_SYNC;
-        newOpa.task = xTaskGetCurrentTaskHandle();
-        //newOpa.BLock = FTL_getLock();
-        //newOpa.StatusBuf = FTL_GetStatusBuf();
-        xTaskNotifyStateClear(NULL);
-        xQueueSend(FTL_Operates_Queue, &newOpa, portMAX_DELAY);
-
-
-        xTaskNotifyWait(0, 0xFFFFFFFF, (uint32_t *)&retVal, portMAX_DELAY);
-    */
-
     return retVal;
 }
 
@@ -19,7 +19,40 @@
 #define GOOD_BLOCK          (0xFFFFFFFF)
 
 #define DATA_START_BLOCK    FLASH_DATA_BLOCK
-#define GC_RATIO        6
+#define GC_RATIO        6       // sets the reserve and so the capacity, keep it fixed for a formatted chip
+
+// Writes may run less inline GC than GC_RATIO, the idle GC makes up for it.
+#define FTL_GC_PART_SWAP        0       // sectors below FLASH_FTL_DATA_SECTOR
+#define FTL_GC_PART_DATA        1
+#define FTL_GC_PARTS            2
+#define FTL_GC_RATIO_SWAP       2
+#define FTL_GC_RATIO_DATA       3
+#define FTL_IDLE_GC_HEADROOM    256     // pages writable without inline GC that the idle GC tries to keep
+#define FTL_IDLE_GC_SLICE       4       // dhara_map_gc() steps per idle slice
+#define FTL_IDLE_GC_PERIOD_MS   10
+
+#define FTL_WCACHE_SLOTS        4       // 2 KB write-back slots for single sector writes, 0 disables the cache
+#define FTL_WCACHE_FLUSH_MS     1000    // dirty slots older than this are written by the FTL task
+#define FTL_WCACHE_NONE         (0xFFFFFFFF)
+
+#define FTL_WEAR_MAX_BLOCKS     (1020)  // erase counters kept, from DATA_START_BLOCK on
+#define FTL_WEAR_SECTOR         (FLASH_FTL_DATA_SECTOR - 1)     // end of the swap area, past VM_SWAP_LOG_SECTORS
+#define FTL_WEAR_MAGIC          (0x52414557)    // "WEAR"
+#define FTL_WEAR_BAD            (0xFFFF)
+#define FTL_WL_SPREAD_MAX       (64)    // erase count spread above which idle time migrates the least worn block
+
+#define FTL_MOUNT_BLOCK         FLASH_MOUNT_BLOCK       // raw block holding mount records, 0 always scans the journal
+                                                        // up to 2 pages per sync and no wear leveling, one erase per 32 syncs
+#define FTL_MOUNT_MAGIC         (0x544E4D46)    // "FMNT"
+#define FTL_BBT_WORDS           ((FTL_WEAR_MAX_BLOCKS + 31) / 32)   // bad block bitmap, same range as the erase counters
+
+#define FTL_WLAT_BUCKETS        12      // log2 histogram of sector write latency
+#define FTL_WLAT_BUCKET0_US     256
+
+#define FTL_MAP_CACHE_SLOTS     512     // sector -> page translations kept in RAM, power of two
+#define FTL_MAP_CACHE_FULL      0       // try to keep one translation per sector (4 bytes each) instead
+#define FTL_READ_RUN_MAX        8       // consecutive flash pages fetched with one multi-page MTD read
+#define FTL_USE_COPY_PAGE       1       // relocate pages inside the NAND controller instead of read + program
 
 typedef enum {
     FTL_SECTOR_READ,
@@ -40,6 +73,49 @@ typedef struct
     TaskHandle_t task;
 }FTL_Operates;
 
+typedef struct FTL_WCacheSlot_t
+{
+    uint32_t sector;
+    uint32_t stamp;     // tick of the first write since the slot was last clean
+    uint32_t lru;
+    bool dirty;
+}FTL_WCacheSlot_t;
+
+// Erase counters, saved as one FTL sector on FTL_Sync().
+typedef struct FTL_WearTable_t
+{
+    uint32_t magic;
+    uint32_t blocks;
+    uint16_t cnt[FTL_WEAR_MAX_BLOCKS];
+}FTL_WearTable_t;
+
+// Journal position written on FTL_Sync(), lets the next boot skip the checkpoint search.
+typedef struct FTL_MountRecord_t
+{
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t clean;     // 0 once the journal moved past this record
+    uint32_t blocks;
+    uint32_t epoch;
+    uint32_t root;
+    uint32_t head;
+    uint32_t count;
+    uint32_t bbtKnown[FTL_BBT_WORDS];   // blocks whose state was read from flash
+    uint32_t bbtBad[FTL_BBT_WORDS];
+    uint32_t crc;       // CRC-32 of the fields above
+}FTL_MountRecord_t;
+
+typedef struct FTL_WearStats_t
+{
+    uint32_t min;
+    uint32_t max;
+    uint32_t avg;
+    uint32_t minBlock;
+    uint32_t maxBlock;
+    uint32_t bad;
+    uint32_t migrated;  // pages moved by the static wear leveling pass
+}FTL_WearStats_t;
+
 typedef struct PartitionInfo_t
 {
   uint32_t Partitions;
@@ -54,6 +130,13 @@ void FTL_task(void);
 
 int FTL_GetSectorCount(void);
 int FTL_GetSectorSize(void);
+void FTL_GetMapCacheStats(uint32_t *hits, uint32_t *misses);
+uint32_t FTL_GetWriteLatency(uint32_t permille);
+void FTL_SetGCRatio(uint32_t part, uint8_t ratio);
+void FTL_NotifyIdle(void);
+void FTL_GetWearStats(FTL_WearStats_t *st);
+uint32_t FTL_GetEraseCount(uint32_t block);
+uint32_t FTL_GetWearBlocks(void);
 
 int FTL_ReadSector(uint32_t sector, uint32_t num, uint8_t *buf);
 int FTL_WriteSector(uint32_t sector, uint32_t num, uint8_t *buf);
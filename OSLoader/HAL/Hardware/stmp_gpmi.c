@@ -99,6 +99,10 @@ static volatile bool ECC_FIN;
 
 static volatile GPMI_Operation GPMI_curOpa;
 static volatile uint32_t GPMI_CopyState = 0;
+static uint32_t GPMI_ReadBlocks = 0;   // ECC blocks of the next GPMI_ReadPage(), 0 for the whole page
+#define GPMI_READ_AUX   (0xFF)          // GPMI_ReadBlocks value decoding only the aux (metadata) block
+static bool GPMI_AuxRead = false;      // the running read decodes the aux block alone
+static volatile uint8_t *GPMI_ReadProbe = NULL;    // aux byte of the running read still holding 0x23
 static uint32_t CopyECCResult;
 
 static uint32_t LastProgTime = 0;
@@ -971,6 +975,19 @@ static inline void    GPMI_sendCommand(uint32_t *cmd, uint32_t *para, uint16_t p
 
 }
 
+// Transfer size and ECC8 buffer mask of the next read, blocks = 0 reads the whole page with its aux block,
+// GPMI_READ_AUX the aux block alone.
+static inline void GPMI_SetReadBlocks(uint32_t blocks)
+{
+    uint32_t count = (blocks == GPMI_READ_AUX) ? (19 + 9) : blocks ? blocks * (512 + 9) : 4 * (512 + 9) + (19 + 9);
+    uint32_t mask = (blocks == GPMI_READ_AUX) ? 0x100 : blocks ? (1 << blocks) - 1 : 0x10F;
+
+    chains_read[4].gpmi_ctrl0   =   (chains_read[4].gpmi_ctrl0 & ~BM_GPMI_CTRL0_XFER_COUNT) | BF_GPMI_CTRL0_XFER_COUNT(count);
+    chains_read[4].gpmi_eccctrl =   (chains_read[4].gpmi_eccctrl & ~BM_GPMI_ECCCTRL_BUFFER_MASK) |
+                                    BF_GPMI_ECCCTRL_BUFFER_MASK(mask);
+    chains_read[4].gpmi_ecccount =  BF_GPMI_ECCCOUNT_COUNT(count);
+}
+
 static inline void   GPMI_ReadPage(uint32_t ColumnAddress, uint32_t RowAddress, uint32_t *data, uint32_t *auxData, bool block)
 {
     volatile uint8_t *probe;
@@ -981,6 +998,9 @@ static inline void   GPMI_ReadPage(uint32_t ColumnAddress, uint32_t RowAddress,
     while ((HW_APBH_CHn_SEMA(NAND_DMA_Channel).B.INCREMENT_SEMA) && !ECC_FIN)
         ;
 
+    // The previous transfer is over, chains_read can be changed.
+    GPMI_SetReadBlocks(GPMI_ReadBlocks);
+
     cmdBuf[0] = NAND_CMD_READ0;
     cmdBuf[1] = ColumnAddress & 0xFF;
     cmdBuf[2] = (ColumnAddress >> 8) & 0xFF;
@@ -1002,8 +1022,12 @@ static inline void   GPMI_ReadPage(uint32_t ColumnAddress, uint32_t RowAddress,
 
     MTD_INFO("WAIT MTD READ FIN\n");
 
+    // Only written when the aux block is decoded.
     probe = (uint8_t *)chains_read[4].gpmi_aux_ptr;
-    probe[16] = 0x23;
+    probe[16] = (GPMI_ReadBlocks && (GPMI_ReadBlocks != GPMI_READ_AUX)) ? 0 : 0x23;
+    GPMI_ReadProbe = (probe[16] == 0x23) ? probe : NULL;
+    GPMI_AuxRead = (GPMI_ReadBlocks == GPMI_READ_AUX);
+    GPMI_ReadBlocks = 0;
 
     ECC_FIN = false;
     ECCResult = 0x0E0E0E0E;
@@ -1031,8 +1055,7 @@ static inline void   GPMI_ReadPage(uint32_t ColumnAddress, uint32_t RowAddress,
         while(HW_APBH_CHn_DEBUG2(NAND_DMA_Channel).B.APB_BYTES);
         //portDelayus(100);
 
-        while(probe[16] == 0x23)
-            ;
+    // The aux block is waited for in portMTDReadSettle(), once the ECC interrupt woke the MTD task.
 }
 
 static inline void    GPMI_EraseBlock(uint32_t blockAddress, bool block)
@@ -1133,10 +1156,14 @@ static inline void    GPMI_WritePage(uint32_t ColumnAddress, uint32_t RowAddress
         while(HW_APBH_CHn_DEBUG2(NAND_DMA_Channel).B.APB_BYTES);
         
         //portDelayus(200);
+    return true;
 }
 
 
-static inline void    GPMI_CopyPage(uint32_t srcPage, uint32_t dstPage)
+// The page goes through the BCH engine and GPMI_DataBuffer instead of the chip's
+// internal copy-back, so corrected bits are not carried over to the new page.
+// Returns false, without programming dstPage, if srcPage could not be corrected.
+static inline bool    GPMI_CopyPage(uint32_t srcPage, uint32_t dstPage)
 {
     waitLastOpa();
     
@@ -1144,6 +1171,8 @@ static inline void    GPMI_CopyPage(uint32_t srcPage, uint32_t dstPage)
     while ((HW_APBH_CHn_SEMA(NAND_DMA_Channel).B.INCREMENT_SEMA) && !ECC_FIN)
         ;
 
+    GPMI_SetReadBlocks(0);
+
     cmdBuf[0] = NAND_CMD_READ0;
     cmdBuf[1] = 0;
     cmdBuf[2] = 0;
@@ -1177,6 +1206,16 @@ static inline void    GPMI_CopyPage(uint32_t srcPage, uint32_t dstPage)
     while ((HW_APBH_CHn_SEMA(NAND_DMA_Channel).B.INCREMENT_SEMA) && (!ECC_FIN))
         ;
 
+    if( (((CopyECCResult ) & 0xF)      == 0xE) || 
+        (((CopyECCResult >> 8) & 0xF)  == 0xE) || 
+        (((CopyECCResult >> 16) & 0xF) == 0xE) || 
+        (((CopyECCResult >> 24) & 0xF) == 0xE) )
+    {
+        LastReadTime = HW_DIGCTL_MICROSECONDS_RD();
+        LastOpa = GPMI_OPA_READ;
+        return false;
+    }
+
     GPMI_curOpa = GPMI_OPA_COPY;
     GPMI_CopyState = 1;
 
@@ -1201,6 +1240,7 @@ static inline void    GPMI_CopyPage(uint32_t srcPage, uint32_t dstPage)
         while(HW_APBH_CHn_DEBUG2(NAND_DMA_Channel).B.APB_BYTES);
         
         //portDelayus(200);
+    return true;
 }
 
 static void NAND_Reset()
@@ -1310,7 +1350,7 @@ void portMTD_DMA_ISR()
         if(GPMI_CopyState == 1){
             if(BF_RDn(APBH_CHn_CURCMDAR, NAND_DMA_Channel, CMD_ADDR) == (uint32_t)&chains_read[8]){
                 INFO("GPMI_OPA_COPY_WRITE psense compare ERROR\n");
-                MTD_upOpaFin(0x0E0E0E0E);
+                MTD_upOpaFin(MTD_COPY_PROG_FAIL);
             }else{
                 MTD_upOpaFin(CopyECCResult);
             }
@@ -1334,6 +1374,11 @@ bool portMTD_ECC_ISR()
                 (BF_RD(ECC8_STATUS1, STATUS_PAYLOAD1) << 8)     |
                 (BF_RD(ECC8_STATUS1, STATUS_PAYLOAD2) << 16)    |
                 (BF_RD(ECC8_STATUS1, STATUS_PAYLOAD3) << 24)    ;
+
+    // Aux only reads report through STATUS_AUX, spread it over the payload fields.
+    if((GPMI_curOpa == GPMI_OPA_READ) && GPMI_AuxRead){
+        ECCResult = BF_RD(ECC8_STATUS0, STATUS_AUX) * 0x01010101;
+    }
     
 
     BF_CLR(ECC8_CTRL, COMPLETE_IRQ);
@@ -1376,6 +1421,33 @@ void portMTDDeviceInit(mtdInfo_t *mtdinfo)
 }
 //static uint32_t lastRDPage = 0xFFFFFFFF;
 
+// Read `blocks` 512 byte ECC blocks starting at block `first` straight into buf.
+void portMTDReadPageBlocks(uint32_t page, uint32_t first, uint32_t blocks, uint8_t *buf)
+{
+    GPMI_ReadBlocks = blocks;
+    GPMI_ReadPage(first * (512 + 9), page, (uint32_t *)buf, NULL, false);
+}
+
+// Decode only the metadata, an erased page reports all ones like a full read.
+void portMTDReadPageMeta(uint32_t page)
+{
+    GPMI_ReadBlocks = GPMI_READ_AUX;
+    GPMI_ReadPage(4 * (512 + 9), page, NULL, NULL, false);
+}
+
+// The ECC interrupt may come before the aux block is in memory, the spin is short
+// here. Bounded so a read that timed out does not hang.
+void portMTDReadSettle()
+{
+    uint32_t t0 = HW_DIGCTL_MICROSECONDS_RD();
+
+    if(GPMI_ReadProbe){
+        while((GPMI_ReadProbe[16] == 0x23) && (HW_DIGCTL_MICROSECONDS_RD() - t0 < 1000))
+            ;
+        GPMI_ReadProbe = NULL;
+    }
+}
+
 void portMTDReadPage(uint32_t page, uint8_t *buf)
 {
     /*
@@ -1413,7 +1485,12 @@ void portMTDEraseBlock(uint32_t block)
     GPMI_EraseBlock(block, false);
 }
 
-void portMTDCopyPage(uint32_t src, uint32_t dst)
+bool portMTDCopyPage(uint32_t src, uint32_t dst)
+{
+    return GPMI_CopyPage(src, dst);
+}
+
+uint32_t portMTDGetCopyECC()
 {
-    GPMI_CopyPage(src, dst);
+    return CopyECCResult;
 }
\ No newline at end of file
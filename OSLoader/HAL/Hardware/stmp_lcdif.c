@@ -15,13 +15,9 @@
 // Screen Size (8 + {127) * 256}
 #define DISPLAY_INVERSE (1)
 
-#define SCREEN_START_Y (8) // 0 - 126
-#define SCREEN_END_Y (136)
-
 #define SCREEN_START_X (0)
 #define SCREEN_END_X (255 / 3) // 0 - 255
 
-#define SCREEN_WIDTH (256)
 #define SCREEN_HEIGHT (127)
 
 typedef struct LCDIF_DMADesc {
@@ -514,6 +510,65 @@ void portDispFlushAreaBuf(uint32_t x_start, uint32_t y_start, uint32_t x_end, ui
     // INFO("ed\n");
 }
 
+void portDispFlushPacked(uint32_t y_start, uint32_t y_end, uint32_t bpp, const uint8_t *buf, const uint8_t *palette, const uint32_t *dirty) {
+    uint32_t stride = SCREEN_WIDTH * bpp / 8;
+    const uint8_t *src;
+    uint8_t *dst;
+    uint8_t b;
+
+    if ((y_start > y_end) || (y_end >= SCREEN_ROWS)) {
+        return;
+    }
+
+    LCDIF_CMD8(0x2A);
+    LCDIF_DAT32(BigEnd16(0) | (BigEnd16((SCREEN_WIDTH - 1) / 3) << 16));
+
+    lineBuffer[sizeof(lineBuffer) - 1] = 0x5A;
+    for (uint32_t y = y_start; y <= y_end; y++) {
+        if (!(dirty[y / 32] & (1UL << (y % 32)))) {
+            continue;
+        }
+        src = &buf[y * stride];
+        dst = lineBuffer;
+        switch (bpp) {
+        case 1:
+            for (uint32_t x = 0; x < SCREEN_WIDTH; x += 8, dst += 8) {
+                b = *src++;
+                if (b == 0) {
+                    memset(dst, palette[0], 8);
+                    continue;
+                }
+                for (int i = 0; i < 8; i++) {
+                    dst[i] = palette[(b >> i) & 1];
+                }
+            }
+            break;
+        case 2:
+            for (uint32_t x = 0; x < SCREEN_WIDTH; x += 4, dst += 4) {
+                b = *src++;
+                dst[0] = palette[b & 3];
+                dst[1] = palette[(b >> 2) & 3];
+                dst[2] = palette[(b >> 4) & 3];
+                dst[3] = palette[(b >> 6) & 3];
+            }
+            break;
+        case 8:
+            memcpy(dst, src, SCREEN_WIDTH);
+            break;
+        default:
+            return;
+        }
+
+        LCDIF_CMD8(0x2B);
+        LCDIF_DAT32(BigEnd16(y + SCREEN_START_Y) | ((BigEnd16(y + SCREEN_START_Y) << 16)));
+        LCDIF_CMD8(0x2C);
+        LCDIF_WriteDAT(lineBuffer, SCREEN_WIDTH);
+    }
+    if (lineBuffer[sizeof(lineBuffer) - 1] != 0x5A) {
+        INFO("LineBuffer Error.\n");
+    }
+}
+
 void DisplayPrepareBatchIn(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1) {
     LCDIF_CMD8(0x2A);
     LCDIF_DAT32(BigEnd16(x0 / 3) | (BigEnd16(x1 / 3) << 16));
@@ -52,6 +52,14 @@ bool driverWaitFalseF(bool (*f)(), TickType_t timeout)
     return false;
 }
 
+uint32_t g_boot_stage_us[BOOT_STAGES];
+
+void boardBootStage(BootStage_t stage)
+{
+    g_boot_stage_us[stage] = portBoardGetTime_us();
+    INFO("Boot stage %d at %lu us\n", stage, g_boot_stage_us[stage]);
+}
+
 void boardInit(void)
 {
     INFO("portBoardInit\n");
@@ -16,6 +16,18 @@ void portDelayms(uint32_t ms);
 
 void boardInit(void);
 
+// Boot milestones, stamped with the microsecond counter that runs from reset.
+typedef enum {
+    BOOT_STAGE_MTD = 0,
+    BOOT_STAGE_FTL,
+    BOOT_STAGE_VM,
+    BOOT_STAGE_SYSTEM,
+    BOOT_STAGES
+} BootStage_t;
+
+extern uint32_t g_boot_stage_us[BOOT_STAGES];
+void boardBootStage(BootStage_t stage);
+
 void portPowerInit();
 uint32_t portGetBatterVoltage_mv();
 uint32_t portLRADCConvCh(uint32_t ch, uint32_t samples);
@@ -22,7 +22,8 @@ typedef enum {
     DISPOPA_BOX,
     DISPOPA_FILL_BOX,
     DISPOPA_SET_INDICATE,
-    DISPOPA_READ_VRAM
+    DISPOPA_READ_VRAM,
+    DISPOPA_FLUSH_PACKED
     //DISPOPA_CIRCLE,
 } DispOpa;
 
@@ -92,6 +93,40 @@ void DisplayFlushArea(uint32_t x_start, uint32_t y_start, uint32_t x_end, uint32
     }
 }
 
+// Full width rows of a 1, 2 or 8bpp buffer, expanded by the display task straight into the line buffer.
+// The palette and the dirty rows are copied, buf is read when the operation runs.
+void DisplayFlushPacked(uint32_t y_start, uint32_t y_end, uint32_t bpp, const uint8_t *buf, const uint8_t *palette, const uint32_t *dirty) {
+    DisplayOpaQueue_t opa;
+    uint32_t *pars = pvPortMalloc((5 + SCREEN_DIRTY_WORDS) * sizeof(uint32_t));
+    uint8_t *pal;
+    if (!pars)
+        return;
+
+    pars[0] = y_start;
+    pars[1] = y_end;
+    pars[2] = bpp;
+    pars[3] = (uint32_t)buf;
+    pal = (uint8_t *)&pars[4];
+    if (palette && (bpp != 8)) {
+        memcpy(pal, palette, bpp == 1 ? 2 : 4);
+    } else {
+        pal[0] = 0x00;
+        pal[1] = bpp == 1 ? 0xFF : 0x55;
+        pal[2] = 0xAA;
+        pal[3] = 0xFF;
+    }
+    if (dirty) {
+        memcpy(&pars[5], dirty, SCREEN_DIRTY_WORDS * sizeof(uint32_t));
+    } else {
+        memset(&pars[5], 0xFF, SCREEN_DIRTY_WORDS * sizeof(uint32_t));
+    }
+
+    opa.opa = DISPOPA_FLUSH_PACKED;
+    opa.parNum = 5 + SCREEN_DIRTY_WORDS;
+    opa.pars = pars;
+    xQueueSend(DisplayOpaQueue, &opa, portMAX_DELAY);
+}
+
 void DisplayPutChar(uint32_t x, uint32_t y, char c, uint8_t fg, uint8_t bg, uint8_t fontSize) {
     DisplayOpaQueue_t opa;
     uint32_t *pars = pvPortMalloc(6 * sizeof(uint32_t));
@@ -358,6 +393,13 @@ void DisplayTask() {
                 vPortFree(curOpa.pars);
             }
 
+            break;
+            case DISPOPA_FLUSH_PACKED: {
+                portDispFlushPacked(curOpa.pars[0], curOpa.pars[1], curOpa.pars[2], (const uint8_t *)curOpa.pars[3],
+                                    (const uint8_t *)&curOpa.pars[4], &curOpa.pars[5]);
+                vPortFree(curOpa.pars);
+            }
+
             break;
             case DISPOPA_PUT_CHAR: {
                 if (curOpa.parNum != 6) {
@@ -20,10 +20,19 @@
 #define INDICATE_TX        (1 << 5)
 #define INDICATE_RX        (1 << 6)
 
+// Visible panel rows SCREEN_START_Y..SCREEN_END_Y - 1, 256 pixels wide.
+#define SCREEN_START_Y     (8)
+#define SCREEN_END_Y       (136)
+#define SCREEN_WIDTH       (256)
+// Rows of a packed flush buffer and the words of its dirty bitmap.
+#define SCREEN_ROWS        (SCREEN_END_Y - SCREEN_START_Y)
+#define SCREEN_DIRTY_WORDS ((SCREEN_ROWS + 31) / 32)
+
 
 void portDispInterfaceInit(void);
 void portDispDeviceInit(void);
 void portDispFlushAreaBuf(uint32_t x_start, uint32_t y_start, uint32_t x_end, uint32_t y_end, uint8_t *buf);
+void portDispFlushPacked(uint32_t y_start, uint32_t y_end, uint32_t bpp, const uint8_t *buf, const uint8_t *palette, const uint32_t *dirty);
 void portDispReadBackVRAM(uint32_t x_start, uint32_t y_start, uint32_t x_end, uint32_t y_end, uint8_t *buf);
 void portDispSetIndicate(int indicateBit, int batteryBit);
 void portDispClean(void);
@@ -34,6 +43,7 @@ void DisplayPrepareBatchIn(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1);
 void DisplayBatchIn(uint8_t *dat, uint32_t len);
 void DisplayReadArea(uint32_t x_start, uint32_t y_start, uint32_t x_end, uint32_t y_end, uint8_t *buf, bool *fin);
 void DisplayFlushArea(uint32_t x_start, uint32_t y_start, uint32_t x_end, uint32_t y_end, uint8_t *buf, bool block);
+void DisplayFlushPacked(uint32_t y_start, uint32_t y_end, uint32_t bpp, const uint8_t *buf, const uint8_t *palette, const uint32_t *dirty);
 void DisplayPutChar(uint32_t x, uint32_t y, char c, uint8_t fg, uint8_t bg, uint8_t fontSize);
 bool DisplayPutStr(uint32_t x, uint32_t y, char *s, uint8_t fg, uint8_t bg, uint8_t fontSize);
 void DisplayBox(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, uint8_t c);
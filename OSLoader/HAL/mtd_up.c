@@ -7,6 +7,8 @@
 #include "nand.h"
 #include "../debug.h"
 
+#include "regsdigctl.h"
+
 static QueueHandle_t MTD_Operates_Queue;
 //static EventGroupHandle_t MTDLockEventGroup;
 //static EventGroupHandle_t MTDDriverOpaDone;
@@ -24,6 +26,7 @@ static uint32_t ECCResult;
 static uint8_t *pMetadata;
 
 static volatile bool mtd_opa_done = false;
+static TaskHandle_t mtdTask;
 
 uint32_t g_mtd_write_cnt = 0;
 uint32_t g_mtd_read_cnt = 0;
@@ -31,6 +34,35 @@ uint32_t g_mtd_erase_cnt = 0;
 uint32_t g_mtd_ecc_cnt = 0;
 uint32_t g_mtd_ecc_fatal_cnt = 0;
 
+// Completion latency per operation class. Bucket n (n > 0) counts [2^n, 2^(n+1)) * MTD_LAT_BUCKET0_US,
+// bucket 0 everything shorter and the last bucket everything longer.
+uint32_t g_mtd_lat_hist[MTD_LAT_CLASSES][MTD_LAT_BUCKETS];
+// Time the MTD task spent blocked on the controller, given back to other tasks.
+uint32_t g_mtd_wait_us = 0;
+
+static void MTD_RecordLatency(MTD_OPAS opa, uint32_t us)
+{
+    uint32_t cls, b = 0;
+
+    switch (opa)
+    {
+    case MTD_PHY_READ:
+    case MTD_PHY_READ_META:
+    case MTD_PHY_READ_MULTI:
+        cls = MTD_LAT_READ;
+        break;
+    case MTD_PHY_ERASE:
+        cls = MTD_LAT_ERASE;
+        break;
+    default:
+        cls = MTD_LAT_PROG;
+        break;
+    }
+    for (us /= MTD_LAT_BUCKET0_US; (us > 1) && (b < MTD_LAT_BUCKETS - 1); us >>= 1)
+        b++;
+    g_mtd_lat_hist[cls][b]++;
+}
+
 uint32_t last_read_page = 0xFFFFFFFF;
 
 void MTD_InterfaceInit()
@@ -41,6 +73,48 @@ void MTD_InterfaceInit()
 
 static uint8_t MTD_PageBuffer[ 2048 ];
 
+// Pages whose last read needed MTD_SCRUB_BITS or more corrections in one ECC block.
+static QueueHandle_t MTD_Scrub_Queue;
+static uint32_t MTD_ScrubLast[4];
+uint32_t g_mtd_scrub_marked = 0;
+
+static void MTD_NoteCorrected(uint32_t page, uint32_t eccResult)
+{
+    uint32_t worst = 0, n;
+
+    for (int i = 0; i < 4; i++)
+    {
+        n = (eccResult >> (8 * i)) & 0xF;
+        if ((n < 0xE) && (n > worst))
+            worst = n;
+    }
+    if ((worst < MTD_SCRUB_BITS) || (MTD_Scrub_Queue == NULL))
+        return;
+    // Hot pages are read over and over before the scrubber gets to them.
+    for (int i = 0; i < 4; i++)
+    {
+        if (MTD_ScrubLast[i] == page)
+            return;
+    }
+    if (xQueueSend(MTD_Scrub_Queue, &page, 0) == pdTRUE)
+    {
+        MTD_ScrubLast[g_mtd_scrub_marked % 4] = page;
+        g_mtd_scrub_marked++;
+    }
+}
+
+bool MTD_GetScrubPage(uint32_t *page)
+{
+    if (MTD_Scrub_Queue == NULL)
+        return false;
+    return xQueueReceive(MTD_Scrub_Queue, page, 0) == pdTRUE;
+}
+
+bool MTD_ScrubPending()
+{
+    return MTD_Scrub_Queue && uxQueueMessagesWaiting(MTD_Scrub_Queue);
+}
+
 bool MTD_isDeviceInited()
 {
     return deviceInited;
@@ -57,10 +131,108 @@ bool MTD_upOpaFin(uint32_t eccResult)
     ECCResult = eccResult;
     mtd_opa_done = true;
     //xEventGroupSetBitsFromISR(MTDDriverOpaDone, 1, &flag);
+    if (mtdTask)
+    {
+        vTaskNotifyGiveFromISR(mtdTask, &flag);
+        portYIELD_FROM_ISR(flag);
+    }
     return flag;
 
 }
 
+static inline bool MTD_ECCFatal(uint32_t eccResult)
+{
+    return  (((eccResult ) & 0xF)      == 0xE) || 
+            (((eccResult >> 8) & 0xF)  == 0xE) || 
+            (((eccResult >> 16) & 0xF) == 0xE) || 
+            (((eccResult >> 24) & 0xF) == 0xE);
+}
+
+// Status of a read that decoded only the first `blocks` ECC blocks, the others
+// report the same as block 0 so the fatal and empty checks keep working.
+static inline uint32_t MTD_ECCBlocks(uint32_t eccResult, uint32_t blocks)
+{
+    for (uint32_t i = blocks; i < 4; i++)
+    {
+        eccResult = (eccResult & ~(0xFF << (8 * i))) | ((eccResult & 0xFF) << (8 * i));
+    }
+    return eccResult;
+}
+
+// One page of a multi-page operation, returns the ISR result.
+static uint32_t MTD_IssuePage(MTD_OPAS opa, uint32_t page, uint8_t *buf)
+{
+    uint32_t t0;
+
+    for (int retry = 5; ; retry--)
+    {
+        mtd_opa_done = false;
+        ulTaskNotifyTake(pdTRUE, 0);
+        t0 = HW_DIGCTL_MICROSECONDS_RD();
+        if (opa == MTD_PHY_READ_MULTI)
+            portMTDReadPage(page, buf);
+        else
+            portMTDWritePage(page, buf);
+
+        while ((mtd_opa_done == false) && ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(2000)))
+            ;
+        if (mtd_opa_done)
+        {
+            portMTDReadSettle();
+            t0 = HW_DIGCTL_MICROSECONDS_RD() - t0;
+            g_mtd_wait_us += t0;
+            MTD_RecordLatency(opa, t0);
+            return ECCResult;
+        }
+        INFO("MTD Waiting Timeout! page:%ld, %d\n", page, retry);
+        if (retry == 0)
+            return 0x0E0E0E0E;
+    }
+}
+
+// Run a whole multi-page request from one queue entry, so the caller and the
+// MTD task switch once per request instead of once per page.
+static void MTD_MultiPageOpa(MTD_Operates *opa)
+{
+    uint8_t *buf = opa->buf;
+    uint32_t res;
+    int ret = 0;
+
+    for (uint32_t i = 0; i < opa->num; i++, buf += mtdinfo.PageSize_B)
+    {
+        if (opa->opa == MTD_PHY_READ_MULTI)
+        {
+            res = MTD_IssuePage(opa->opa, opa->page + i, opa->needToMoveData ? MTD_PageBuffer : buf);
+            if (opa->needToMoveData)
+                memcpy(buf, MTD_PageBuffer, mtdinfo.PageSize_B);
+            if ((res > 1) && (res < 0x0F0F0F0F))
+            {
+                g_mtd_ecc_cnt++;
+                MTD_NoteCorrected(opa->page + i, res);
+            }
+            last_read_page = opa->page + i;
+            if (MTD_ECCFatal(res))
+            {
+                MTD_WARN("BAD BLOCK:%ld\n", opa->page + i);
+                ret = -1;
+                break;
+            }
+        }
+        else
+        {
+            if (opa->needToMoveData)
+                memcpy(MTD_PageBuffer, buf, mtdinfo.PageSize_B);
+            res = MTD_IssuePage(opa->opa, opa->page + i, opa->needToMoveData ? MTD_PageBuffer : buf);
+            if (res)
+            {
+                ret = res;
+                break;
+            }
+        }
+    }
+    xTaskNotify(opa->task, ret, eSetValueWithOverwrite);
+}
+
 uint32_t retry_cnt;
 void MTD_Task()
 {
@@ -71,12 +243,21 @@ void MTD_Task()
         {
             enterSlowDown();
 
+            if((curOpa.opa == MTD_PHY_READ_MULTI) || (curOpa.opa == MTD_PHY_WRITE_MULTI))
+            {
+                MTD_MultiPageOpa(&curOpa);
+                exitSlowDown();
+                continue;
+            }
 
             retry_cnt = 5;
             retry:
 
             MTD_INFO("MTD REC OPA\n");
             mtd_opa_done = false;
+            // Drop a completion left over from an operation that timed out.
+            ulTaskNotifyTake(pdTRUE, 0);
+            uint32_t start_us = HW_DIGCTL_MICROSECONDS_RD();
 
             switch (curOpa.opa)
             {
@@ -89,6 +270,8 @@ void MTD_Task()
                 {
                     MTD_INFO_READ("Move Dat Read,page:%d,%p\n",curOpa.page,MTD_PageBuffer);
                     portMTDReadPage(curOpa.page, MTD_PageBuffer);
+                }else if(curOpa.buf && (curOpa.len != mtdinfo.PageSize_B)){
+                    portMTDReadPageBlocks(curOpa.page, curOpa.offset / 512, curOpa.len / 512, curOpa.buf);
                 }else{
                     portMTDReadPage(curOpa.page, curOpa.buf);
                 }
@@ -96,7 +279,11 @@ void MTD_Task()
                 break;
             case MTD_PHY_READ_META:
                 MTD_INFO_READ("MTD READ META:page:%d\n", curOpa.page);
+#if MTD_META_ONLY_READ
+                portMTDReadPageMeta(curOpa.page);
+#else
                 portMTDReadPage(curOpa.page, NULL);
+#endif
                 break;
 
 
@@ -134,17 +321,22 @@ void MTD_Task()
                 break;
 
             case MTD_PHY_COPY:
-                portMTDCopyPage(curOpa.page, curOpa.copyDstPage);
+                if (!portMTDCopyPage(curOpa.page, curOpa.copyDstPage))
+                {
+                    // Uncorrectable source, the destination is left erased.
+                    ECCResult = portMTDGetCopyECC();
+                    mtd_opa_done = true;
+                }
                 break;
                 
             default:
                 MTD_WARN("UNEXCEPTED MTD REC OPA!\n");
                 break;
             }
-            uint32_t start_tick = xTaskGetTickCount();
+            // The DMA/ECC ISR notifies us through MTD_upOpaFin(), block until then.
             while(mtd_opa_done == false)
             {
-                if(xTaskGetTickCount() - start_tick > pdMS_TO_TICKS(2000)){
+                if((ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(2000)) == 0) && (mtd_opa_done == false)){
                     INFO("MTD Waiting Timeout! %ld\n", retry_cnt);
                     INFO("Cur opa:%d\n", curOpa.opa);
                     INFO("Cur opa.page:%ld\n", curOpa.page);
@@ -153,8 +345,8 @@ void MTD_Task()
                     INFO("Cur opa.buf:%p\n", curOpa.buf);
                     if(retry_cnt)
                     {
-                        goto retry;
                         retry_cnt--;
+                        goto retry;
                     }else{
                         mtd_opa_done = true;
                         ECCResult = 0x0E0E0E0E;
@@ -168,6 +360,10 @@ void MTD_Task()
                 
             }
             //xEventGroupWaitBits(MTDDriverOpaDone, 1, pdTRUE, pdFALSE, portMAX_DELAY);
+            portMTDReadSettle();
+            start_us = HW_DIGCTL_MICROSECONDS_RD() - start_us;
+            g_mtd_wait_us += start_us;
+            MTD_RecordLatency(curOpa.opa, start_us);
 
 
             switch (curOpa.opa)
@@ -175,6 +371,10 @@ void MTD_Task()
             case MTD_PHY_READ_META:
                 memcpy(curOpa.buf, portMTDGetMetaData(), curOpa.len);
             case MTD_PHY_READ:
+                if((curOpa.opa == MTD_PHY_READ) && !curOpa.needToMoveData && curOpa.buf && (curOpa.len != mtdinfo.PageSize_B))
+                {
+                    ECCResult = MTD_ECCBlocks(ECCResult, curOpa.len / 512);
+                }
                 if(curOpa.needToMoveData)
                 {
                     if(curOpa.len > mtdinfo.PageSize_B - curOpa.offset){
@@ -207,6 +407,7 @@ void MTD_Task()
                 //if((ECCResult != 0))
                     //printf("ECC Err found:%08lX, PhySector:%ld\n",ECCResult, curOpa.page);
                     g_mtd_ecc_cnt++;
+                    MTD_NoteCorrected(curOpa.page, ECCResult);
                 
                 }
                 last_read_page = curOpa.page;
@@ -227,24 +428,20 @@ void MTD_Task()
                     break;
 
                 case MTD_PHY_COPY:
-                    if( 
-                        (((ECCResult ) & 0xF)      == 0xE) || 
-                        (((ECCResult >> 8) & 0xF)  == 0xE) || 
-                        (((ECCResult >> 16) & 0xF) == 0xE) || 
-                        (((ECCResult >> 24) & 0xF) == 0xE) 
-                    ){
+                    if(ECCResult == MTD_COPY_PROG_FAIL){
+                        xTaskNotify(curOpa.task, 1, eSetValueWithOverwrite);
+                    }else if(MTD_ECCFatal(ECCResult)){
                         g_mtd_ecc_fatal_cnt++;
                         MTD_WARN("BAD BLOCK:%ld\n", curOpa.page);
-                        //*curOpa.StatusBuf =  -1;
                         xTaskNotify(curOpa.task, -1, eSetValueWithOverwrite);
-                    }else if(ECCResult == 0x0F0F0F0F){
-                        xTaskNotify(curOpa.task, 0, eSetValueWithOverwrite);
-                        //*curOpa.StatusBuf = 0;      //EMPTY
-                    }else {
+                    }else{
+                        if((ECCResult > 1) && (ECCResult < 0x0F0F0F0F))
+                        {
+                            g_mtd_ecc_cnt++;
+                            MTD_NoteCorrected(curOpa.page, ECCResult);
+                        }
                         xTaskNotify(curOpa.task, 0, eSetValueWithOverwrite);
-                        //*curOpa.StatusBuf = 0;
                     }
-
                     break;
 
             default:
@@ -336,9 +533,14 @@ int MTD_ReadPhyPage(uint32_t page, uint32_t offset, uint32_t len, uint8_t *buffe
     newOpa.task = xTaskGetCurrentTaskHandle();
 
 
-    if((offset != 0) || (len != mtdinfo.PageSize_B) || (((uint32_t)buffer & 3) != 0)){
+    if((offset != 0) || (len != mtdinfo.PageSize_B) || !MTD_DMA_BUFFER(buffer)){
         newOpa.needToMoveData = true;
     }
+#if MTD_COLUMN_READ
+    if(MTD_DMA_BUFFER(buffer) && len && (((offset | len) & 511) == 0) && (offset + len <= mtdinfo.PageSize_B)){
+        newOpa.needToMoveData = false;
+    }
+#endif
     if(buffer == NULL){
         newOpa.needToMoveData = false;
     }
@@ -379,7 +581,7 @@ int MTD_WritePhyPage(uint32_t page,uint8_t *buffer)
         INFO("Data is not loaded in RAM.\n");
     }
     */
-    if(((uint32_t)buffer) & 0x3)
+    if(!MTD_DMA_BUFFER(buffer))
     {
         newOpa.needToMoveData = true;
     }
@@ -413,6 +615,58 @@ int MTD_WritePhyPage(uint32_t page,uint8_t *buffer)
 
 
 
+// Read num consecutive pages into buffer, returns -1 if one of them could not be corrected.
+int MTD_ReadPhyPages(uint32_t page, uint32_t num, uint8_t *buffer)
+{
+    MTD_Operates newOpa;
+    int retVal;
+
+    newOpa.opa = MTD_PHY_READ_MULTI;
+    newOpa.page = page;
+    newOpa.num = num;
+    newOpa.buf = buffer;
+    newOpa.needToMoveData = !MTD_DMA_BUFFER(buffer);
+    newOpa.task = xTaskGetCurrentTaskHandle();
+
+    while (!deviceInited)
+    {
+        vTaskDelay(2);
+    }
+
+    g_mtd_read_cnt += num;
+    xTaskNotifyStateClear(NULL);
+    xQueueSend(MTD_Operates_Queue, &newOpa, portMAX_DELAY);
+    xTaskNotifyWait(0, 0xFFFFFFFF, (uint32_t *)&retVal, portMAX_DELAY);
+
+    return retVal;
+}
+
+// Program num consecutive pages from buffer, stops at the first page that fails.
+int MTD_WritePhyPages(uint32_t page, uint32_t num, uint8_t *buffer)
+{
+    MTD_Operates newOpa;
+    int retVal;
+
+    newOpa.opa = MTD_PHY_WRITE_MULTI;
+    newOpa.page = page;
+    newOpa.num = num;
+    newOpa.buf = buffer;
+    newOpa.needToMoveData = !MTD_DMA_BUFFER(buffer);
+    newOpa.task = xTaskGetCurrentTaskHandle();
+
+    while (!deviceInited)
+    {
+        vTaskDelay(2);
+    }
+
+    g_mtd_write_cnt += num;
+    xTaskNotifyStateClear(NULL);
+    xQueueSend(MTD_Operates_Queue, &newOpa, portMAX_DELAY);
+    xTaskNotifyWait(0, 0xFFFFFFFF, (uint32_t *)&retVal, portMAX_DELAY);
+
+    return retVal;
+}
+
 int MTD_ErasePhyBlock(uint32_t block)
 {
     MTD_Operates newOpa;
@@ -533,10 +787,7 @@ int MTD_WritePhyPageWithMeta(uint32_t page, uint32_t meta_len, uint8_t *buffer,
     //newOpa.StatusBuf = MTD_GetStatusBuf();
     newOpa.task = xTaskGetCurrentTaskHandle();
 
-    if(((uint32_t)buffer) & 3)
-    {
-        newOpa.needToMoveData = true;
-    }
+    newOpa.needToMoveData = !MTD_DMA_BUFFER(buffer);
 
     g_mtd_write_cnt++;
 
@@ -597,6 +848,9 @@ int MTD_CopyPhyPage(uint32_t srcPage, uint32_t dstPage)
 void MTD_DeviceInit()
 {
     MTD_Operates_Queue = xQueueCreate(4, sizeof(MTD_Operates));
+    MTD_Scrub_Queue = xQueueCreate(MTD_SCRUB_SLOTS, sizeof(uint32_t));
+    memset(MTD_ScrubLast, 0xFF, sizeof(MTD_ScrubLast));
+    mtdTask = xTaskGetCurrentTaskHandle();
     printf("MTD_Operates_Queue:%p\n", MTD_Operates_Queue);
     portMTDDeviceInit(&mtdinfo);
 
@@ -7,6 +7,8 @@
 #include "semphr.h"
 #include "event_groups.h"
 
+#include "SystemConfig.h"
+
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -29,10 +31,34 @@ typedef enum {
     MTD_PHY_ERASE,
     MTD_PHY_READ_META,
     MTD_PHY_WRITE_META,
-    MTD_PHY_COPY
+    MTD_PHY_COPY,
+    MTD_PHY_READ_MULTI,
+    MTD_PHY_WRITE_MULTI
     
 }MTD_OPAS;
 
+// Partial reads covering whole 512 byte ECC blocks fetch only those blocks, with a column
+// address, straight into the caller buffer. Off until verified on more NAND parts.
+#define MTD_COLUMN_READ     (0)
+
+// Metadata reads decode only the aux block instead of the whole page.
+#define MTD_META_ONLY_READ  (1)
+
+// The NAND DMA needs a word aligned physical address. RAM below MEMORY_SIZE is identity
+// mapped and uncached, so no cache maintenance is needed around transfers to it.
+#define MTD_DMA_RANGE(b, len)   ((((uint32_t)(b) & 3) == 0) && ((uint32_t)(b) + (len) <= MEMORY_SIZE))
+#define MTD_DMA_BUFFER(b)       MTD_DMA_RANGE(b, 1)
+
+#define MTD_SCRUB_BITS      3       // corrected bits in one ECC block (of 4) that mark a page for refresh
+#define MTD_SCRUB_SLOTS     16
+
+#define MTD_LAT_READ        0
+#define MTD_LAT_PROG        1
+#define MTD_LAT_ERASE       2
+#define MTD_LAT_CLASSES     3
+#define MTD_LAT_BUCKETS     10
+#define MTD_LAT_BUCKET0_US  64
+
 typedef struct
 {
     MTD_OPAS opa;
@@ -42,6 +68,7 @@ typedef struct
     uint8_t *buf;
     uint8_t *metaDat;
     uint32_t len;
+    uint32_t num;           // pages of a multi-page operation
     bool needToMoveData;
     TaskHandle_t task;
     
@@ -51,12 +78,18 @@ typedef struct
 void portMTDInterfaceInit(void);
 void portMTDDeviceInit(mtdInfo_t *mtdinfo);
 void portMTDReadPage(uint32_t page, uint8_t *buf);
+void portMTDReadPageBlocks(uint32_t page, uint32_t first, uint32_t blocks, uint8_t *buf);
+void portMTDReadPageMeta(uint32_t page);
+void portMTDReadSettle(void);
 void portMTDWritePage(uint32_t page, uint8_t *buf);
 void portMTDEraseBlock(uint32_t block);
 uint8_t *portMTDGetMetaData(void);
 void portMTDWritePageMeta(uint32_t page, uint8_t *buf, uint8_t *metaBuf);
 
-void portMTDCopyPage(uint32_t src, uint32_t dst);
+bool portMTDCopyPage(uint32_t src, uint32_t dst);
+uint32_t portMTDGetCopyECC(void);
+
+#define MTD_COPY_PROG_FAIL      (0xFFFFFFFF)    // completion result of a copy whose program step failed
 
 bool MTD_upOpaFin(uint32_t eccResult);
 
@@ -68,14 +101,20 @@ mtdInfo_t *MTD_getDeviceInfo();
 
 int MTD_ReadPhyPage(uint32_t page, uint32_t offset, uint32_t len, uint8_t *buffer);
 int MTD_WritePhyPage(uint32_t page,uint8_t *buffer);
+int MTD_ReadPhyPages(uint32_t page, uint32_t num, uint8_t *buffer);
+int MTD_WritePhyPages(uint32_t page, uint32_t num, uint8_t *buffer);
 int MTD_ErasePhyBlock(uint32_t block);
 //int MTD_WritePhyPageMeta(uint32_t page, uint32_t len, uint8_t *buffer);
 
 int MTD_WritePhyPageWithMeta(uint32_t page, uint32_t meta_len, uint8_t *buffer, uint8_t *meta);
 
 int MTD_ReadPhyPageMeta(uint32_t page, uint32_t len, uint8_t *buffer);
+// Returns 0 on success, -1 if the source page is uncorrectable (nothing is programmed),
+// 1 if programming the destination failed.
 int MTD_CopyPhyPage(uint32_t srcPage, uint32_t dstPage);
 int MTD_EraseAllBLock(void);
+bool MTD_GetScrubPage(uint32_t *page);
+bool MTD_ScrubPending(void);
 
 
 #endif
\ No newline at end of file
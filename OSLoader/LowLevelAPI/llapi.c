@@ -16,6 +16,7 @@
 #include "../debug.h"
 
 #include "FTL_up.h"
+#include "mtd_up.h"
 #include "mmu.h"
 #include "vmMgr.h"
 
@@ -281,7 +282,10 @@ void LLAPI_init(TaskHandle_t upSys) {
     vm_timer = xTimerCreate("Tick Timer", pdMS_TO_TICKS(10), pdTRUE, NULL, tickTimer);
 }
 
-static uint32_t data_page_buffer[2048 / sizeof(uint32_t)];
+static uint32_t data_page_buffer[LLAPI_FLASH_BOUNCE_PAGES * 2048 / sizeof(uint32_t)];
+
+// Buffers outside MTD_DMA_RANGE go through data_page_buffer so their page faults
+// are taken here instead of in the FTL or MTD task.
 
 bool g_llapi_fin = true;
 
@@ -480,6 +484,37 @@ void __attribute__((target("thumb"))) LLAPI_Task_thumb_entry() {
 
             } break;
 
+            case LL_SWI_DISPLAY_FLUSH_PACKED: {
+                if ((!vmMgr_checkAddressValid(currentCall.para0, PERM_R)) ||
+                    (!vmMgr_checkAddressValid(currentCall.para0 + sizeof(ll_disp_packed_t) - 1, PERM_R))) {
+                    break;
+                }
+                ll_disp_packed_t *desc = (ll_disp_packed_t *)currentCall.para0;
+                uint32_t stride = SCREEN_WIDTH * desc->bpp / 8;
+
+                if (((desc->bpp != 1) && (desc->bpp != 2) && (desc->bpp != 8)) ||
+                    (desc->y0 > desc->y1) || (desc->y1 >= SCREEN_ROWS)) {
+                    break;
+                }
+                if ((!vmMgr_checkAddressValid((uint32_t)desc->buf + desc->y0 * stride, PERM_R)) ||
+                    (!vmMgr_checkAddressValid((uint32_t)desc->buf + (desc->y1 + 1) * stride - 1, PERM_R))) {
+                    break;
+                }
+                if ((desc->palette && (desc->bpp != 8)) &&
+                    ((!vmMgr_checkAddressValid((uint32_t)desc->palette, PERM_R)) ||
+                     (!vmMgr_checkAddressValid((uint32_t)desc->palette + (desc->bpp == 1 ? 2 : 4) - 1, PERM_R)))) {
+                    break;
+                }
+                if (desc->dirty &&
+                    ((!vmMgr_checkAddressValid((uint32_t)desc->dirty, PERM_R)) ||
+                     (!vmMgr_checkAddressValid((uint32_t)desc->dirty + SCREEN_DIRTY_WORDS * sizeof(uint32_t) - 1, PERM_R)))) {
+                    break;
+                }
+
+                DisplayFlushPacked(desc->y0, desc->y1, desc->bpp, desc->buf, desc->palette, desc->dirty);
+
+            } break;
+
             case LL_SWI_CLKCTL_GET_DIV: {
                 if ((!vmMgr_checkAddressValid(currentCall.para0, PERM_W)) ||
                     (!vmMgr_checkAddressValid(currentCall.para0 + 4, PERM_R)) ||
@@ -522,12 +557,20 @@ void __attribute__((target("thumb"))) LLAPI_Task_thumb_entry() {
                     break;
                 }
                 LLAPI_INFO("VM Read:%d, pages:%d, buf:%08x\n", currentCall.para0, currentCall.para1, currentCall.para2);
+                if (MTD_DMA_RANGE(currentCall.para2, pages * 2048)) {
+                    ret = FTL_ReadSector(FLASH_FTL_DATA_SECTOR + spage, pages, (uint8_t *)buffer);
+                    if (ret) {
+                        INFO("LL_SWI_FLASH_PAGE_READ FAIL:%d\n", ret);
+                    }
+                    pages = 0;
+                }
                 while (pages) {
-                    ret = FTL_ReadSector(FLASH_FTL_DATA_SECTOR + spage, 1, (uint8_t *)data_page_buffer);
-                    memcpy(buffer, data_page_buffer, 2048);
-                    buffer += (2048 / sizeof(uint32_t));
-                    spage++;
-                    pages--;
+                    uint32_t n = pages > LLAPI_FLASH_BOUNCE_PAGES ? LLAPI_FLASH_BOUNCE_PAGES : pages;
+                    ret = FTL_ReadSector(FLASH_FTL_DATA_SECTOR + spage, n, (uint8_t *)data_page_buffer);
+                    memcpy(buffer, data_page_buffer, n * 2048);
+                    buffer += n * (2048 / sizeof(uint32_t));
+                    spage += n;
+                    pages -= n;
                     if (ret) {
                         INFO("LL_SWI_FLASH_PAGE_READ FAIL:%d\n", ret);
                         *currentCall.pRet = ret;
@@ -547,12 +590,20 @@ void __attribute__((target("thumb"))) LLAPI_Task_thumb_entry() {
                     break;
                 }
                 LLAPI_INFO("VM Write:%d, pages:%d, buf:%08x\n", currentCall.para0, currentCall.para1, currentCall.para2);
+                if (MTD_DMA_RANGE(currentCall.para2, pages * 2048)) {
+                    ret = FTL_WriteSector(FLASH_FTL_DATA_SECTOR + spage, pages, (uint8_t *)buffer);
+                    if (ret) {
+                        INFO("LL_SWI_FLASH_PAGE_WRITE FAIL:%d\n", ret);
+                    }
+                    pages = 0;
+                }
                 while (pages) {
-                    memcpy(data_page_buffer, buffer, 2048);
-                    ret = FTL_WriteSector(FLASH_FTL_DATA_SECTOR + spage, 1, (uint8_t *)data_page_buffer);
-                    buffer += (2048 / sizeof(uint32_t));
-                    spage++;
-                    pages--;
+                    uint32_t n = pages > LLAPI_FLASH_BOUNCE_PAGES ? LLAPI_FLASH_BOUNCE_PAGES : pages;
+                    memcpy(data_page_buffer, buffer, n * 2048);
+                    ret = FTL_WriteSector(FLASH_FTL_DATA_SECTOR + spage, n, (uint8_t *)data_page_buffer);
+                    buffer += n * (2048 / sizeof(uint32_t));
+                    spage += n;
+                    pages -= n;
                     if (ret) {
                         INFO("LL_SWI_FLASH_PAGE_WRITE FAIL:%d\n", ret);
                         *currentCall.pRet = ret;
@@ -600,7 +651,8 @@ void __attribute__((target("thumb"))) LLAPI_Task_thumb_entry() {
 
             case LL_SWI_PWR_POWEROFF:
             {
-                
+                // Write back cached sectors and checkpoint the map before the power goes.
+                FTL_Sync();
                 portBoardPowerOff();
             }break;
 
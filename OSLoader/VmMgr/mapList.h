@@ -6,6 +6,8 @@
 #define MAP_PART_FTL        2
 #define MAP_PART_SYS        3
 
+#define MAPLIST_INDEX_SEGS  64      // 1MB segments covered by the map lookup index
+
 typedef struct MapList_t
 {
     struct MapList_t *next;
@@ -308,18 +308,10 @@ void mmu_dumpMapInfo()
     }
 }
 
-void mmu_unmap_page(uint32_t vaddr)
+// L2 table of the segment holding vaddr, the segment is put back into the hardware DFLPT if it was dropped.
+static uint32_t *mmu_get_l2tab(uint32_t seg)
 {
-    
     uint32_t *L1PTE = (uint32_t *)DFLPT_BASE;
-    uint32_t seg = vaddr >> 20;
-    if(seg == 0)
-    {
-        INFO("Can not ummap seg 0!\n");
-        return;
-    }
-
-    //VM_INFO("unmap_vaddr:%08x, seg:%d\n",vaddr, seg);
 
 #if USE_HARDWARE_DFLPT
     bool found = false;
@@ -347,10 +339,95 @@ void mmu_unmap_page(uint32_t vaddr)
     }
 #endif
 
+    return ((uint32_t *)(L1PTE[ seg ] & ~0x3FF)); // check which seg (0~4095)
+}
+
+uint32_t g_mmu_demote_cnt = 0;
+
+#if USE_TINY_PAGE
+
+// A fine table maps a small (4 KB) or large (64 KB) page by repeating its descriptor
+// over all the tiny slots it covers. Before one of them is changed the whole run is
+// split back into tiny pages, each keeping the AP of its subpage.
+static void mmu_demote(uint32_t *L2PTE, uint32_t ind)
+{
+    uint32_t val = L2PTE[ind];
+    uint32_t n, base, ap_shift;
+
+    switch (val & 0x3)
+    {
+    case 2: // small
+        n = 4;
+        base = val & 0xFFFFF000;
+        break;
+    case 1: // large
+        n = 64;
+        base = val & 0xFFFF0000;
+        break;
+    default:
+        return;
+    }
+    ind &= ~(n - 1);
+    for(uint32_t i = 0; i < n; i++)
+    {
+        ap_shift = 4 + 2 * (i / (n / 4));
+        L2PTE[ind + i] = (base + i * PAGE_SIZE) | (((val >> ap_shift) & 0x3) << 4) | (val & 0xC) | 3;
+    }
+    g_mmu_demote_cnt++;
+}
+
+// Map npages (4 or 64) physically contiguous tiny pages as one small or large page.
+// vaddr and paddr must be aligned to the region size, later map/unmap calls inside it demote it again.
+void mmu_map_region(uint32_t vaddr, uint32_t paddr, uint32_t npages,
+    uint32_t AP, bool cache, bool buffer)
+{
+    uint32_t seg = vaddr >> 20;
+    uint32_t *L2PTE;
+    uint32_t val;
+
+    if(seg == 0)
+    {
+        INFO("Can not remap seg 0!\n");
+        return;
+    }
+    L2PTE = mmu_get_l2tab(seg);
+
+    val  = (AP & 0x3) << 4;
+    val |= (AP & 0x3) << 6;
+    val |= (AP & 0x3) << 8;
+    val |= (AP & 0x3) << 10;
+    val |= ((cache & 1) << 3);
+    val |= ((buffer & 1) << 2);
+    if(npages == 64)
+        val |= (paddr & 0xFFFF0000) | 1;
+    else
+        val |= (paddr & 0xFFFFF000) | 2;
+
+    for(uint32_t i = 0; i < npages; i++)
+    {
+        L2PTE[((vaddr >> 10) & 0x3FF) + i] = val;
+    }
+    VM_INFO("map region L2PTE:VAL:%08x x %d\n", val, npages);
+
+    mmu_invalidate_tlb();
+}
+#endif
+
+void mmu_unmap_page(uint32_t vaddr)
+{
+    uint32_t seg = vaddr >> 20;
+    if(seg == 0)
+    {
+        INFO("Can not ummap seg 0!\n");
+        return;
+    }
+
+    //VM_INFO("unmap_vaddr:%08x, seg:%d\n",vaddr, seg);
 
-    uint32_t *L2PTE = ((uint32_t *)(L1PTE[  seg ] & ~0x3FF));
+    uint32_t *L2PTE = mmu_get_l2tab(seg);
 
     #if USE_TINY_PAGE
+        mmu_demote(L2PTE, (vaddr >> 10) & 0x3FF);
         L2PTE[(vaddr >> 10) & 0x3FF] = 0;
     #else
         L2PTE[(vaddr >> 12) & 0xFF] = 0;
@@ -364,7 +441,6 @@ void mmu_map_page(uint32_t vaddr, uint32_t paddr,
 {
     
     uint32_t seg = vaddr >> 20;
-    uint32_t *L1PTE = (uint32_t *)DFLPT_BASE;
     uint32_t *L2PTE;
 
     if(seg == 0)
@@ -373,37 +449,12 @@ void mmu_map_page(uint32_t vaddr, uint32_t paddr,
         return;
     }
 
-#if USE_HARDWARE_DFLPT
-    bool found = false;
-    for(int i = 1; i < 8; i++)
-    {
-        if(GetMPTELoc(i) == seg)
-        {
-            found = true;
-            break;
-        }
-    }
-    if(!found)
-    {
-        for(int i = 0; i < MAX_SEG_SUPPORTED; i++)
-        {
-            if((MPTE_Table[i].seg == seg))
-            {
-                SetMPTELoc(HW_MPTE_Ptr, seg);
-                INC_HW_MPTE_Ptr();
-                L1PTE[seg] = MPTE_Table[i].val;
-                //mmu_invalidate_tlb();
-                break;
-            }
-        }
-    }
-#endif
-
-    L2PTE = ((uint32_t *)(L1PTE[ seg  ] & ~0x3FF)); // check which seg (0~4095)
+    L2PTE = mmu_get_l2tab(seg);
 
     uint32_t val = 0;
 
 #if USE_TINY_PAGE
+    mmu_demote(L2PTE, (vaddr >> 10) & 0x3FF);
     val  = (paddr & (~0x3FF));
     val |= (AP & 0x3) << 4;
     val |= ((cache & 1) << 3);
@@ -37,6 +37,15 @@ void mmu_map_page(
 
 void mmu_unmap_page(uint32_t vaddr);
 
+void mmu_map_region(
+    uint32_t vaddr,
+    uint32_t paddr,
+    uint32_t npages,
+    uint32_t AP,
+    bool cache,
+    bool buffer
+    );
+
 void mmu_clean_invalidated_cache_index(uint32_t index);
 void mmu_clean_invalidated_dcache(uint32_t buffer, uint32_t size);
 void mmu_clean_dcache(uint32_t buffer, uint32_t size);
@@ -601,6 +601,36 @@ size_t get_max_size(void *mem_pool)
 #endif
 }
 
+/******************************************************************/
+size_t get_max_free_size(void *mem_pool)
+{
+/******************************************************************/
+    tlsf_t *tlsf = (tlsf_t *) mem_pool;
+    size_t max = 0;
+    bhdr_t *b;
+    int fl, sl;
+
+    if (!tlsf->fl_bitmap)
+        return 0;
+    /* The biggest free block sits in the highest non empty list */
+    fl = ms_bit(tlsf->fl_bitmap);
+    sl = ms_bit(tlsf->sl_bitmap[fl]);
+    for (b = tlsf->matrix[fl][sl]; b; b = b->ptr.free_ptr.next) {
+        if ((b->size & BLOCK_SIZE) > max)
+            max = b->size & BLOCK_SIZE;
+    }
+    return max;
+}
+
+/******************************************************************/
+size_t get_block_size(void *ptr)
+{
+/******************************************************************/
+    bhdr_t *b = (bhdr_t *) ((char *) ptr - BHDR_OVERHEAD);
+
+    return b->size & BLOCK_SIZE;
+}
+
 /******************************************************************/
 void destroy_memory_pool(void *mem_pool)
 {
@@ -14,34 +14,63 @@
 //#include "mem_malloc.h"
 #include "mmu.h"
 #include "queue.h"
+#include "semphr.h"
 #include "vmMgr.h"
+#include "vmPolicy.h"
+#include "vmSwap.h"
 
 #include "minilzo.h"
 #include "quicklz.h"
 #include "tlsf/tlsf.h"
 
-typedef struct CachePageInfo_t {
-    struct CachePageInfo_t *prev;
-    struct CachePageInfo_t *next;
-    uint32_t mapToVirtAddr;
-    uint32_t PageOnPhyAddr;
-    uint32_t onPart;
-    uint32_t onSector;
-    uint32_t sectorOffset;
-    bool dirty;
-    bool lock;
-} CachePageInfo_t;
+#include "regsdigctl.h"
+
+#define VADDR_HASH(vaddr, mask)     (((vaddr) / PAGE_SIZE) & (mask))
+
+static inline CachePageInfo_t *cache_hash_find(CachePageInfo_t **tab, uint32_t mask, uint32_t vaddr) {
+    CachePageInfo_t *tmp = tab[VADDR_HASH(vaddr, mask)];
+    while (tmp) {
+        if (tmp->mapToVirtAddr == vaddr) {
+            return tmp;
+        }
+        tmp = tmp->hnext;
+    }
+    return NULL;
+}
+
+// Rebind a cache page to a new virtual address and keep the hash in sync.
+static inline void cache_hash_remap(CachePageInfo_t **tab, uint32_t mask, CachePageInfo_t *item, uint32_t vaddr) {
+    CachePageInfo_t **pp;
+    if (item->mapToVirtAddr) {
+        pp = &tab[VADDR_HASH(item->mapToVirtAddr, mask)];
+        while (*pp) {
+            if (*pp == item) {
+                *pp = item->hnext;
+                break;
+            }
+            pp = &(*pp)->hnext;
+        }
+    }
+    item->hnext = NULL;
+    item->mapToVirtAddr = vaddr;
+    if (vaddr) {
+        item->hnext = tab[VADDR_HASH(vaddr, mask)];
+        tab[VADDR_HASH(vaddr, mask)] = item;
+    }
+}
 
 
 
 
 static MapList_t *maplist;
+static MapList_t *mapSegIndex[MAPLIST_INDEX_SEGS];  // 1MB segment -> map covering it
 
 
 static inline void mapListInit()
 {
     maplist = pvPortMalloc(sizeof(MapList_t));
     memset(maplist, 0, sizeof(MapList_t));
+    memset(mapSegIndex, 0, sizeof(mapSegIndex));
 }
 
 
@@ -64,6 +93,12 @@ static inline uint32_t mapList_AddPartitionMap(int part, uint32_t perm, uint32_t
         chain = chain->next;
     }
     chain->next = tmp;
+
+    for(uint32_t seg = VMemStartAddr >> 20; (seg < MAPLIST_INDEX_SEGS) && (seg <= ((VMemStartAddr + memSize - 1) >> 20)); seg++){
+        if(mapSegIndex[seg] == NULL){
+            mapSegIndex[seg] = tmp;
+        }
+    }
     return 0;
 }
 
@@ -71,6 +106,13 @@ static inline MapList_t *mapList_findVirtAddrInWhichMap(uint32_t Addr)
 {
     MapList_t *chain = maplist;
 
+    if((Addr >> 20) < MAPLIST_INDEX_SEGS){
+        MapList_t *L = mapSegIndex[Addr >> 20];
+        if( L && (Addr >= L->VMemStartAddr) && (Addr < (L->VMemStartAddr + L->memSize)) ){
+            return L;
+        }
+    }
+
     if(  (Addr >= chain->VMemStartAddr) && (Addr < (chain->VMemStartAddr + chain->memSize))  ){
          return chain;
     }
@@ -92,19 +134,40 @@ static inline MapList_t *mapList_findVirtAddrInWhichMap(uint32_t Addr)
 uint8_t CachePageTotal[PAGE_SIZE * (NUM_CACHEPAGE_VROM + NUM_CACHEPAGE_VRAM)] __attribute__((aligned(PAGE_SIZE)));
 uint8_t *CachePageVROM = &CachePageTotal[0];
 uint8_t *CachePageVRAM = &CachePageTotal[PAGE_SIZE * NUM_CACHEPAGE_VROM];
-uint8_t ZRAM[ZRAM_SIZE];
+uint8_t ZRAM[ZRAM_SIZE] __attribute__((aligned(8)));     // TLSF blocks keep BLOCK_ALIGN (8) relative to the pool start
 
 uint32_t ZRAMAddress_Tab[ZRAM_COMPRESSED_SIZE / 1024];
+// Same-filled pages are kept in ZRAMAddress_Tab as a tagged fill word instead of a block pointer.
+// ZRAM lives in the low memory, so bit 31 is never set in a real pointer.
+#define ZRAM_FILL_TAG               (0x80000000)
+#define ZRAM_IS_FILLED(e)           ((e) & ZRAM_FILL_TAG)
+#define ZRAM_FILL_ENCODABLE(w)      (((((w) >> 31) ^ ((w) >> 30)) & 1) == 0)
+#define ZRAM_FILL_ENCODE(w)         (ZRAM_FILL_TAG | ((w) & 0x7FFFFFFF))
+#define ZRAM_FILL_DECODE(e)         ((uint32_t)((int32_t)((e) << 1) >> 1))
+// Otherwise the low bits of the (8 bytes aligned) block pointer tell how the page was stored.
+#define ZRAM_CODEC_MASK             (0x3)
+#define ZRAM_CODEC_LZO              (0)
+#define ZRAM_CODEC_RAW              (1)
+#define ZRAM_CODEC(e)               ((e) & ZRAM_CODEC_MASK)
+#define ZRAM_BLOCK(e)               ((void *)((e) & ~ZRAM_CODEC_MASK))
 static CachePageInfo_t CachePageInfoVROM[NUM_CACHEPAGE_VROM];
 static CachePageInfo_t CachePageInfoVRAM[NUM_CACHEPAGE_VRAM];
 
 static volatile CachePageInfo_t *CachePageVROMCur;
-static volatile CachePageInfo_t *CachePageVROMHead;
-static volatile CachePageInfo_t *CachePageVROMTail;
-
 static volatile CachePageInfo_t *CachePageVRAMCur;
-static volatile CachePageInfo_t *CachePageVRAMHead;
-static volatile CachePageInfo_t *CachePageVRAMTail;
+
+static CachePool_t VROMPool;
+static CachePool_t VRAMPool;
+static uint32_t VROMGhost[NUM_CACHEPAGE_VROM / 2];
+static uint32_t VRAMGhost[NUM_CACHEPAGE_VRAM / 2];
+
+// Held while the VRAM pool or ZRAM is touched, shared with the writeback task.
+static SemaphoreHandle_t VRAMPoolLock;
+
+static CachePageInfo_t *CachePageVROMHash[VM_CACHE_HASH_BUCKETS_VROM];
+static CachePageInfo_t *CachePageVRAMHash[VM_CACHE_HASH_BUCKETS_VRAM];
+#define VROM_HASH_MASK  (VM_CACHE_HASH_BUCKETS_VROM - 1)
+#define VRAM_HASH_MASK  (VM_CACHE_HASH_BUCKETS_VRAM - 1)
 
 #define CACHEVROM_PAGEn_BASE(n) (uint32_t)(&CachePageVROM[n * PAGE_SIZE])
 #define CACHEVRAM_PAGEn_BASE(n) (uint32_t)(&CachePageVRAM[n * PAGE_SIZE])
@@ -117,6 +180,8 @@ static CachePageInfo_t CachePageInfo[NUM_CACHEPAGE];
 static volatile CachePageInfo_t *CachePageCur;
 static volatile CachePageInfo_t *CachePageHead;
 static volatile CachePageInfo_t *CachePageTail;
+static CachePageInfo_t *CachePageHash[VM_CACHE_HASH_BUCKETS];
+#define CACHE_HASH_MASK (VM_CACHE_HASH_BUCKETS - 1)
 #define CACHE_PAGEn_BASE(n) (uint32_t)(&CachePage[n * PAGE_SIZE])
 #endif
 
@@ -131,6 +196,23 @@ extern TaskHandle_t upSystem;
 extern bool upSystemInException;
 uint32_t g_page_vram_fault_cnt = 0;
 uint32_t g_page_vrom_fault_cnt = 0;
+uint32_t g_page_soft_fault_cnt = 0;
+uint32_t g_page_compress_cnt = 0;
+uint32_t g_page_raw_cnt = 0;
+uint32_t g_page_writeback_cnt = 0;
+uint32_t g_page_readahead_cnt = 0;
+uint32_t g_page_prefetch_cnt = 0;
+uint32_t g_page_fault_around_cnt = 0;
+uint32_t g_page_evict_clean_cnt = 0;
+uint32_t g_page_evict_dirty_cnt = 0;
+uint32_t g_page_evict_clean_us = 0;
+uint32_t g_page_evict_dirty_us = 0;
+uint32_t g_page_promote_cnt = 0;
+uint32_t g_page_promote_moved = 0;
+
+// Per 1 MB region, hardware DFLPT segment reloads (the only TLB misses software sees) and page faults.
+uint32_t g_seg_dflpt_miss_cnt[MAPLIST_INDEX_SEGS];
+uint32_t g_seg_fault_cnt[MAPLIST_INDEX_SEGS];
 
 extern bool g_vm_in_pagefault;
 
@@ -244,87 +326,60 @@ void zram_info(uint32_t *free, uint32_t *total)
 
 }
 
-static inline void get_vrom_page_and_move_to_tail() {
-
-    CachePageVROMCur = CachePageVROMHead;
-
-    CachePageVROMHead = CachePageVROMHead->next;
-    CachePageVROMHead->prev = NULL;
-
-    CachePageVROMTail->next = (CachePageInfo_t *)CachePageVROMCur;
-    CachePageVROMCur->prev = (CachePageInfo_t *)CachePageVROMTail;
-    CachePageVROMCur->next = NULL;
+uint32_t g_zram_frag = 0;          // largest free block / total free, in permille
+uint32_t g_zram_compact_cnt = 0;
+uint32_t g_zram_compact_moved = 0;
+static bool zram_compact_again = true;     // cleared by a pass that moved nothing, set again when a block is freed
 
-    CachePageVROMTail = CachePageVROMCur;
+uint32_t zram_frag_info()
+{
+    return g_zram_frag;
 }
-static inline void get_vram_page_and_move_to_tail() {
-
-    CachePageVRAMCur = CachePageVRAMHead;
-
-    CachePageVRAMHead = CachePageVRAMHead->next;
-    CachePageVRAMHead->prev = NULL;
 
-    CachePageVRAMTail->next = (CachePageInfo_t *)CachePageVRAMCur;
-    CachePageVRAMCur->prev = (CachePageInfo_t *)CachePageVRAMTail;
-    CachePageVRAMCur->next = NULL;
-
-    CachePageVRAMTail = CachePageVRAMCur;
+static inline void zram_update_frag()
+{
+    uint32_t free = ZRAM_SIZE - get_used_size(ZRAM);
+    g_zram_frag = free ? (uint64_t)get_max_free_size(ZRAM) * 1000 / free : 1000;
 }
 
-static inline void move_vrom_cache_page_to_tail(CachePageInfo_t *item) {
-    if ((!item->next) && (item->prev)) {
-        return;
-    }
-    if ((item->prev) && (item->next)) {
-        item->prev->next = item->next;
-        item->next->prev = item->prev;
-        item->prev = (CachePageInfo_t *)CachePageVROMTail;
-        CachePageVROMTail->next = item;
-        CachePageVROMTail = item;
-        return;
-    }
-    if ((item->next) && (!item->prev)) {
-        get_vrom_page_and_move_to_tail();
-    }
-}
+// Move compressed blocks into lower holes of the pool so the free space coalesces.
+// Every block is owned by exactly one ZRAMAddress_Tab entry, so only that entry has to follow.
+static void zram_compact()
+{
+    void *old, *blk;
+    uint32_t sz;
+    uint32_t moved = g_zram_compact_moved;
 
-static inline void move_vram_cache_page_to_tail(CachePageInfo_t *item) {
-    if ((!item->next) && (item->prev)) {
-        return;
-    }
-    if ((item->prev) && (item->next)) {
-        item->prev->next = item->next;
-        item->next->prev = item->prev;
-        item->prev = (CachePageInfo_t *)CachePageVRAMTail;
-        CachePageVRAMTail->next = item;
-        CachePageVRAMTail = item;
-        return;
-    }
-    if ((item->next) && (!item->prev)) {
-        get_vram_page_and_move_to_tail();
+    g_zram_compact_cnt++;
+    for (int i = 0; i < (ZRAM_COMPRESSED_SIZE / PAGE_SIZE); i++) {
+        if ((ZRAMAddress_Tab[i] == 0) || ZRAM_IS_FILLED(ZRAMAddress_Tab[i])) {
+            continue;
+        }
+        old = ZRAM_BLOCK(ZRAMAddress_Tab[i]);
+        sz = get_block_size(old);
+        blk = tlsf_malloc(sz);
+        if (blk == NULL) {
+            continue;
+        }
+        if ((uint32_t)blk < (uint32_t)old) {
+            memcpy(blk, old, sz);
+            tlsf_free(old);
+            ZRAMAddress_Tab[i] = (uint32_t)blk | ZRAM_CODEC(ZRAMAddress_Tab[i]);
+            g_zram_compact_moved++;
+        } else {
+            tlsf_free(blk);
+        }
     }
+    zram_compact_again = (g_zram_compact_moved != moved);
+    zram_update_frag();
 }
 
 static inline CachePageInfo_t *search_vrom_cache_page_by_vaddr(uint32_t vaddr) {
-    CachePageInfo_t *tmp = (CachePageInfo_t *)CachePageVROMTail;
-    do {
-        if (tmp->mapToVirtAddr == vaddr) {
-            return tmp;
-        }
-        tmp = tmp->prev;
-    } while (tmp);
-    return NULL;
+    return cache_hash_find(CachePageVROMHash, VROM_HASH_MASK, vaddr);
 }
 
 static inline CachePageInfo_t *search_vram_cache_page_by_vaddr(uint32_t vaddr) {
-    CachePageInfo_t *tmp = (CachePageInfo_t *)CachePageVRAMTail;
-    do {
-        if (tmp->mapToVirtAddr == vaddr) {
-            return tmp;
-        }
-        tmp = tmp->prev;
-    } while (tmp);
-    return NULL;
+    return cache_hash_find(CachePageVRAMHash, VRAM_HASH_MASK, vaddr);
 }
 
 // char compress_buffer[PAGE_SIZE + 42];
@@ -335,6 +390,112 @@ uint32_t comp_wrkbuffer[2048 / 4];
 
 extern uint32_t g_mem_comp_rate[16];
 extern uint32_t g_mem_comp_rate_ptr;
+extern uint32_t g_mem_dedup_hits;
+extern uint32_t g_mem_dedup_total;
+
+// Store the page as a fill word if all of its words are the same, no ZRAM block is needed then.
+static inline bool zram_store_same_filled(uint32_t ind, const uint32_t *page) {
+    uint32_t w = page[0];
+
+    g_mem_dedup_total++;
+    for (int i = 1; i < PAGE_SIZE / sizeof(uint32_t); i++) {
+        if (page[i] != w) {
+            return false;
+        }
+    }
+    if (!ZRAM_FILL_ENCODABLE(w)) {
+        return false;
+    }
+    if (ZRAMAddress_Tab[ind] && !ZRAM_IS_FILLED(ZRAMAddress_Tab[ind])) {
+        tlsf_free(ZRAM_BLOCK(ZRAMAddress_Tab[ind]));
+        zram_compact_again = true;
+    }
+    ZRAMAddress_Tab[ind] = ZRAM_FILL_ENCODE(w);
+    g_mem_dedup_hits++;
+    g_mem_comp_rate[g_mem_comp_rate_ptr++] = 0;
+    if (g_mem_comp_rate_ptr >= 16) {
+        g_mem_comp_rate_ptr = 0;
+    }
+    return true;
+}
+
+// Sample the page and count distinct byte values, random-looking data is not worth running LZO on.
+static inline bool zram_estimate_incompressible(const uint8_t *page) {
+    uint32_t seen[256 / 32];
+    uint32_t distinct = 0;
+
+    memset(seen, 0, sizeof(seen));
+    for (int i = 0; i < PAGE_SIZE; i += PAGE_SIZE / VM_ZRAM_ESTIMATE_SAMPLES) {
+        if (!(seen[page[i] / 32] & (1 << (page[i] % 32)))) {
+            seen[page[i] / 32] |= (1 << (page[i] % 32));
+            distinct++;
+        }
+    }
+    return distinct > VM_ZRAM_ESTIMATE_DISTINCT;
+}
+
+#if MEM_COMPRESSION_ALGORITHM == MINILZO
+// Compress the page or keep it raw, returns the size of the blob left in *src.
+static inline uint32_t zram_encode(const uint8_t *page, void **src, uint32_t *codec) {
+    uint32_t sz = PAGE_SIZE;
+
+    *codec = ZRAM_CODEC_RAW;
+    *src = (void *)page;
+    if (!zram_estimate_incompressible(page)) {
+        g_page_compress_cnt++;
+        int ret = lzo1x_1_compress(page, PAGE_SIZE, (unsigned char *)compress_buffer, &sz, comp_wrkbuffer);
+        if (ret == LZO_E_OK) {
+            lzo_sizeof_dict_t;
+            // printf("comp:%d>%d\n", PAGE_SIZE, sz);
+        } else {
+            printf("COMPERR:%d\n", ret);
+            while (1)
+                ;
+        }
+        if (sz <= VM_ZRAM_RAW_THRESHOLD) {
+            *codec = ZRAM_CODEC_LZO;
+            *src = compress_buffer;
+        } else {
+            sz = PAGE_SIZE;
+        }
+    }
+    if (*codec == ZRAM_CODEC_RAW) {
+        g_page_raw_cnt++;
+    }
+    g_mem_comp_rate[g_mem_comp_rate_ptr++] = sz * 100 / PAGE_SIZE;
+    if (g_mem_comp_rate_ptr >= 16) {
+        g_mem_comp_rate_ptr = 0;
+    }
+    return sz;
+}
+
+static inline void zram_decode(const void *blob, uint32_t len, uint32_t codec, uint8_t *page) {
+    uint32_t sz;
+    int ret;
+
+    if (codec == ZRAM_CODEC_RAW) {
+        memcpy(page, blob, PAGE_SIZE);
+        return;
+    }
+    ret = lzo1x_decompress(blob, len, page, &sz, NULL);
+    if ((ret == LZO_E_OK) || (ret == LZO_E_INPUT_NOT_CONSUMED) || (ret == LZO_E_INPUT_OVERRUN)) {
+
+    } else {
+        printf("DECOMP ERR:%d\n", ret);
+        while (1)
+            ;
+    }
+}
+#endif
+
+static inline void zram_restore_same_filled(uint32_t *page, uint32_t w) {
+    for (int i = 0; i < PAGE_SIZE / sizeof(uint32_t); i += 4) {
+        page[i] = w;
+        page[i + 1] = w;
+        page[i + 2] = w;
+        page[i + 3] = w;
+    }
+}
 static inline int save_cache_page(CachePageInfo_t *cache_page) {
     // sizeof(comp_state);
     // sizeof(decomp_state);
@@ -352,6 +513,10 @@ static inline int save_cache_page(CachePageInfo_t *cache_page) {
             //
             // memcpy(mem_buffer(ZRAMAddress_Tab[ind]), (void *)cache_page->PageOnPhyAddr, PAGE_SIZE);
             // memset(workbuf_comp, 0, sizeof(workbuf_comp));
+            if (zram_store_same_filled(ind, (uint32_t *)cache_page->PageOnPhyAddr)) {
+                cache_page->dirty = false;
+                return 0;
+            }
 #if MEM_COMPRESSION_ALGORITHM == QUICKLZ
             sz = qlz_compress((void *)cache_page->PageOnPhyAddr, compress_buffer, PAGE_SIZE, (qlz_state_compress *)&comp_state);
             g_mem_comp_rate[g_mem_comp_rate_ptr++] = sz * 100 / PAGE_SIZE;
@@ -363,25 +528,40 @@ static inline int save_cache_page(CachePageInfo_t *cache_page) {
             cdmp_wrtie(ZRAMAddress_Tab[ind], 0, sz, (void *)compress_buffer);
 #endif
 #if MEM_COMPRESSION_ALGORITHM == MINILZO
-            int ret = lzo1x_1_compress((void *)cache_page->PageOnPhyAddr, PAGE_SIZE, (char *)compress_buffer, &sz, comp_wrkbuffer);
-            if (ret == LZO_E_OK) {
-                lzo_sizeof_dict_t;
-                // printf("comp:%d>%d\n", PAGE_SIZE, sz);
-            } else {
-                printf("COMPERR:%d\n", ret);
-                while (1)
-                    ;
+            uint32_t codec;
+            uint32_t oldsz;
+            void *src;
+            void *blk;
+            void *old;
+
+            sz = zram_encode((uint8_t *)cache_page->PageOnPhyAddr, &src, &codec);
+
+            // Only worth it when the pool is fragmented rather than full, and
+            // something was freed since a pass that could not move anything.
+            if (zram_compact_again && (get_max_free_size(ZRAM) < VM_ZRAM_COMPACT_MIN_FREE) &&
+                ((ZRAM_SIZE - get_used_size(ZRAM)) >= VM_ZRAM_COMPACT_MIN_FREE * 2)) {
+                zram_compact();
             }
-            g_mem_comp_rate[g_mem_comp_rate_ptr++] = sz * 100 / PAGE_SIZE;
-            if (g_mem_comp_rate_ptr >= 16) {
-                g_mem_comp_rate_ptr = 0;
+            old = ZRAM_IS_FILLED(ZRAMAddress_Tab[ind]) ? NULL : ZRAM_BLOCK(ZRAMAddress_Tab[ind]);
+            oldsz = old ? get_block_size(old) : 0;
+            blk = tlsf_realloc(old, sz);
+            if (blk == NULL) {
+                zram_compact();
+                old = ZRAM_IS_FILLED(ZRAMAddress_Tab[ind]) ? NULL : ZRAM_BLOCK(ZRAMAddress_Tab[ind]);
+                oldsz = old ? get_block_size(old) : 0;
+                blk = tlsf_realloc(old, sz);
             }
-
-            ZRAMAddress_Tab[ind] = (uint32_t)tlsf_realloc((void *)ZRAMAddress_Tab[ind], sz);
-            if(ZRAMAddress_Tab[ind])
+            // A moved or shrunk block leaves a hole behind.
+            if (old && blk && ((blk != old) || (get_block_size(blk) < oldsz))) {
+                zram_compact_again = true;
+            }
+            zram_update_frag();
+            if(blk)
             {
-                memcpy((void *)ZRAMAddress_Tab[ind], (void *)compress_buffer, sz );
+                memcpy(blk, src, sz);
+                ZRAMAddress_Tab[ind] = (uint32_t)blk | codec;
             }else{
+                ZRAMAddress_Tab[ind] = 0;
                 printf("ZRAM OOM!\n");
                 return -2;
             }
@@ -414,10 +594,13 @@ static inline int save_cache_page(CachePageInfo_t *cache_page) {
         } else {
             // printf("TO SWAP AREA\n");
             if (mem_swap_enable) {
-                FTL_ReadSector(cache_page->onSector, 1, (uint8_t *)compress_buffer);
-                memcpy((void *)((uint32_t)compress_buffer + cache_page->sectorOffset), (uint8_t *)cache_page->PageOnPhyAddr, PAGE_SIZE);
-                FTL_WriteSector(cache_page->onSector, 1, (uint8_t *)compress_buffer);
-
+                uint32_t codec;
+                void *src;
+                sz = zram_encode((uint8_t *)cache_page->PageOnPhyAddr, &src, &codec);
+                if (vmSwap_store(ind - (ZRAM_COMPRESSED_SIZE / PAGE_SIZE), src, sz, codec)) {
+                    // Not stored anywhere, the page has to stay dirty and resident.
+                    return -2;
+                }
             } else {
                 printf("SWAP IS NOT ENABLE!!\n");
                 return -3;
@@ -452,6 +635,315 @@ static inline int save_cache_page(CachePageInfo_t *cache_page) {
     return ret;
 }
 
+// A VROM tiny page is half of a NAND page, whole NAND pages are read and kept
+// here so the neighbouring tiny pages cost only a memcpy. Read-ahead fills
+// several consecutive NAND pages with one multi-page MTD request.
+#define VROM_NAND_BUF_PAGES     ((VM_READAHEAD_MAX_PAGES + 1) / 2 + 1)
+static uint32_t vrom_nand_buf[VROM_NAND_BUF_PAGES * 2048 / sizeof(uint32_t)];
+static uint32_t vrom_nand_buf_page = 0xFFFFFFFF;
+static uint32_t vrom_nand_buf_num = 0;
+static uint32_t vrom_last_fault;
+static uint32_t vrom_ra_window;
+
+// `ahead` is the number of NAND pages worth fetching if the one holding vaddr is not buffered.
+// NULL if every cache page is locked.
+static CachePageInfo_t *vrom_load_page(MapList_t *mapinfo, uint32_t vaddr, uint32_t ahead) {
+    CachePageInfo_t *page = vmPolicy_victim(&VROMPool);
+    if (page == NULL) {
+        return NULL;
+    }
+    if (page->mapToVirtAddr) {
+        // The guest may be running during the reads below, it must not reach the frame through a stale TLB entry.
+        mmu_clean_invalidated_dcache(page->mapToVirtAddr, PAGE_SIZE);
+        mmu_unmap_page(page->mapToVirtAddr);
+        mmu_invalidate_tlb();
+    }
+    cache_hash_remap(CachePageVROMHash, VROM_HASH_MASK, page, vaddr);
+    page->onPart = mapinfo->part;
+    page->onSector = mapinfo->PartStartSector + ((vaddr - mapinfo->VMemStartAddr) & 0xFFFFFC00) / 2048;
+    page->sectorOffset = (vaddr / 1024) % 2 ? 1024 : 0;
+    page->dirty = false;
+    vmPolicy_insert(&VROMPool, page);
+
+#if MTD_COLUMN_READ
+    // A lone fault fetches only its half of the NAND page, straight into the frame.
+    if ((ahead <= 1) && ((page->onSector < vrom_nand_buf_page) || (page->onSector >= vrom_nand_buf_page + vrom_nand_buf_num))) {
+        MTD_ReadPhyPage(page->onSector, page->sectorOffset, PAGE_SIZE, (uint8_t *)page->PageOnPhyAddr);
+        mmu_map_page(page->mapToVirtAddr, page->PageOnPhyAddr, AP_READONLY, VM_CACHE_ENABLE, VM_BUFFER_ENABLE);
+        return page;
+    }
+#endif
+    if ((page->onSector < vrom_nand_buf_page) || (page->onSector >= vrom_nand_buf_page + vrom_nand_buf_num)) {
+        if (ahead > VROM_NAND_BUF_PAGES) {
+            ahead = VROM_NAND_BUF_PAGES;
+        }
+        if (ahead > 1) {
+            MTD_ReadPhyPages(page->onSector, ahead, (uint8_t *)vrom_nand_buf);
+        } else {
+            ahead = 1;
+            MTD_ReadPhyPage(page->onSector, 0, 2048, (uint8_t *)vrom_nand_buf);
+        }
+        vrom_nand_buf_page = page->onSector;
+        vrom_nand_buf_num = ahead;
+    }
+    memcpy((void *)page->PageOnPhyAddr, (uint8_t *)vrom_nand_buf + (page->onSector - vrom_nand_buf_page) * 2048 + page->sectorOffset, PAGE_SIZE);
+
+    mmu_map_page(page->mapToVirtAddr, page->PageOnPhyAddr, AP_READONLY, VM_CACHE_ENABLE, VM_BUFFER_ENABLE);
+    return page;
+}
+
+// Load VROM pages of [vaddr, vaddr + len) that are not cached yet, returns the number loaded.
+static uint32_t vrom_load_range(uint32_t vaddr, uint32_t len, uint32_t max) {
+    MapList_t *mapinfo;
+    uint32_t n = 0;
+    uint32_t last;
+
+    vaddr &= ~(PAGE_SIZE - 1);
+    for (uint32_t end = vaddr + len; (vaddr < end) && (n < max); vaddr += PAGE_SIZE) {
+        mapinfo = mapList_findVirtAddrInWhichMap(vaddr);
+        if ((mapinfo == NULL) || (mapinfo->part != MAP_PART_RAWFLASH)) {
+            break;
+        }
+        if (search_vrom_cache_page_by_vaddr(vaddr)) {
+            continue;
+        }
+        // NAND pages still covered by the range, clipped to the end of the mapping.
+        last = mapinfo->VMemStartAddr + mapinfo->memSize;
+        if (end < last) {
+            last = end;
+        }
+        if (!vrom_load_page(mapinfo, vaddr, (last - 1 - mapinfo->VMemStartAddr) / 2048 - (vaddr - mapinfo->VMemStartAddr) / 2048 + 1)) {
+            break;
+        }
+        // Whether it will be fetched as code or data is unknown.
+        mmu_clean_invalidated_dcache(vaddr, PAGE_SIZE);
+        n++;
+    }
+    if (n) {
+        mmu_invalidate_icache();
+        mmu_invalidate_tlb();
+    }
+    return n;
+}
+
+#if VM_PROMOTE_PAGES
+#if (VM_PROMOTE_PAGES != 4) && (VM_PROMOTE_PAGES != 64)
+#error "VM_PROMOTE_PAGES must be 0, 4 or 64"
+#endif
+#define VM_PROMOTE_SIZE     (VM_PROMOTE_PAGES * PAGE_SIZE)
+
+static CachePageInfo_t *vrom_frame_owner(uint32_t phys) {
+    for (int i = 0; i < NUM_CACHEPAGE_VROM; i++) {
+        if (CachePageInfoVROM[i].PageOnPhyAddr == phys) {
+            return &CachePageInfoVROM[i];
+        }
+    }
+    return NULL;
+}
+
+// Exchange the frames of two VROM cache pages, content and mapping follow the vaddr.
+// VROM is never dirty and the VIVT cache is indexed by vaddr, so only the TLB needs flushing.
+// compress_buffer is free since the caller holds VRAMPoolLock.
+static void vrom_swap_frames(CachePageInfo_t *a, CachePageInfo_t *b) {
+    uint32_t phys = a->PageOnPhyAddr;
+
+    memcpy(compress_buffer, (void *)a->PageOnPhyAddr, PAGE_SIZE);
+    memcpy((void *)a->PageOnPhyAddr, (void *)b->PageOnPhyAddr, PAGE_SIZE);
+    memcpy((void *)b->PageOnPhyAddr, compress_buffer, PAGE_SIZE);
+    a->PageOnPhyAddr = b->PageOnPhyAddr;
+    b->PageOnPhyAddr = phys;
+    // Pages left unmapped by CLOCK stay unmapped.
+    if (a->mapToVirtAddr && !a->referenced) {
+        mmu_unmap_page(a->mapToVirtAddr);
+    } else if (a->mapToVirtAddr) {
+        mmu_map_page(a->mapToVirtAddr, a->PageOnPhyAddr, AP_READONLY, VM_CACHE_ENABLE, VM_BUFFER_ENABLE);
+    }
+    if (b->mapToVirtAddr && !b->referenced) {
+        mmu_unmap_page(b->mapToVirtAddr);
+    } else if (b->mapToVirtAddr) {
+        mmu_map_page(b->mapToVirtAddr, b->PageOnPhyAddr, AP_READONLY, VM_CACHE_ENABLE, VM_BUFFER_ENABLE);
+    }
+    g_page_promote_moved++;
+}
+
+// Once every page of the aligned region around vaddr is resident, move them into an aligned run
+// of frames (the run already holding most of them) and map the region with a single descriptor.
+// Any later map/unmap inside the region, eviction included, demotes it to tiny pages again.
+static bool vrom_try_promote(uint32_t vaddr) {
+    CachePageInfo_t *want[VM_PROMOTE_PAGES];
+    CachePageInfo_t *owner;
+    uint32_t base = vaddr & ~(VM_PROMOTE_SIZE - 1);
+    uint32_t first = CACHEVROM_PAGEn_BASE(0);
+    uint32_t end = CACHEVROM_PAGEn_BASE(NUM_CACHEPAGE_VROM);
+    uint32_t run, best = 0, best_hits = 0, hits;
+
+    for (int k = 0; k < VM_PROMOTE_PAGES; k++) {
+        want[k] = search_vrom_cache_page_by_vaddr(base + k * PAGE_SIZE);
+        if ((want[k] == NULL) || want[k]->lock) {
+            return false;
+        }
+    }
+
+    for (run = (first + VM_PROMOTE_SIZE - 1) & ~(VM_PROMOTE_SIZE - 1); run + VM_PROMOTE_SIZE <= end; run += VM_PROMOTE_SIZE) {
+        hits = 0;
+        for (int k = 0; k < VM_PROMOTE_PAGES; k++) {
+            if (want[k]->PageOnPhyAddr == run + k * PAGE_SIZE) {
+                hits++;
+            }
+        }
+        if (!best || (hits > best_hits)) {
+            best = run;
+            best_hits = hits;
+        }
+    }
+    if (!best) {
+        return false;
+    }
+    if (best_hits < VM_PROMOTE_PAGES) {
+        for (uint32_t phys = best; phys < best + VM_PROMOTE_SIZE; phys += PAGE_SIZE) {
+            owner = vrom_frame_owner(phys);
+            if (owner->lock) {
+                return false;
+            }
+        }
+        for (int k = 0; k < VM_PROMOTE_PAGES; k++) {
+            if (want[k]->PageOnPhyAddr != best + k * PAGE_SIZE) {
+                vrom_swap_frames(want[k], vrom_frame_owner(best + k * PAGE_SIZE));
+            }
+        }
+    }
+
+    for (int k = 0; k < VM_PROMOTE_PAGES; k++) {
+        want[k]->referenced = true;
+    }
+    mmu_map_region(base, best, VM_PROMOTE_PAGES, AP_READONLY, VM_CACHE_ENABLE, VM_BUFFER_ENABLE);
+    g_page_promote_cnt++;
+    return true;
+}
+#endif
+
+// Map the pages following a VRAM fault that are already in ZRAM, decompressing them in the same pass.
+// Stops at the first page that is resident, not in ZRAM or would need a dirty victim written back.
+// Returns the number of pages mapped, the caller does the cache/TLB maintenance for the whole run.
+static uint32_t vram_fault_around(MapList_t *mapinfo, CachePageInfo_t *faulted) {
+    CachePageInfo_t *page;
+    uint32_t vaddr = faulted->mapToVirtAddr;
+    uint32_t sector, offset, ind;
+    uint32_t n = 0;
+
+    for (vaddr += PAGE_SIZE; n < VM_FAULT_AROUND_PAGES; vaddr += PAGE_SIZE, n++) {
+        if (vaddr >= mapinfo->VMemStartAddr + mapinfo->memSize) {
+            break;
+        }
+        sector = mapinfo->PartStartSector + ((vaddr - mapinfo->VMemStartAddr) & 0xFFFFFC00) / 2048;
+        offset = (vaddr / 1024) % 2 ? 1024 : 0;
+        ind = (sector * 2048 + offset) / PAGE_SIZE;
+        if ((ind >= (ZRAM_COMPRESSED_SIZE / PAGE_SIZE)) || (ZRAMAddress_Tab[ind] == 0)) {
+            break;
+        }
+        if (search_vram_cache_page_by_vaddr(vaddr)) {
+            break;
+        }
+        // Only take the victim once it is known to be reusable, taking it has side effects.
+        page = vmPolicy_peekVictim(&VRAMPool);
+        if ((page == NULL) || (page == faulted) || page->dirty || page->lock) {
+            break;
+        }
+        if (vmPolicy_victim(&VRAMPool) != page) {
+            break;
+        }
+        if (page->mapToVirtAddr) {
+            mmu_unmap_page(page->mapToVirtAddr);
+        }
+        cache_hash_remap(CachePageVRAMHash, VRAM_HASH_MASK, page, vaddr);
+        page->onPart = mapinfo->part;
+        page->onSector = sector;
+        page->sectorOffset = offset;
+        page->dirty = false;
+        vmPolicy_insert(&VRAMPool, page);
+        if (ZRAM_IS_FILLED(ZRAMAddress_Tab[ind])) {
+            zram_restore_same_filled((uint32_t *)page->PageOnPhyAddr, ZRAM_FILL_DECODE(ZRAMAddress_Tab[ind]));
+        } else {
+            zram_decode(ZRAM_BLOCK(ZRAMAddress_Tab[ind]), PAGE_SIZE, ZRAM_CODEC(ZRAMAddress_Tab[ind]), (uint8_t *)page->PageOnPhyAddr);
+        }
+        mmu_map_page(vaddr, page->PageOnPhyAddr, AP_READONLY, VM_CACHE_ENABLE, VM_BUFFER_ENABLE);
+        g_page_fault_around_cnt++;
+    }
+    return n;
+}
+
+// The page may still be resident but unmapped by the replacement policy,
+// then only the mapping has to be restored.
+static inline bool vmMgr_softFault(pageFaultInfo_t *fault, MapList_t *mapinfo) {
+    CachePool_t *pool;
+    CachePageInfo_t *page;
+    uint32_t vaddr = fault->FaultMemAddr & ~(PAGE_SIZE - 1);
+
+    switch (mapinfo->part) {
+    case MAP_PART_RAWFLASH:
+        pool = &VROMPool;
+        page = search_vrom_cache_page_by_vaddr(vaddr);
+        break;
+    case MAP_PART_FTL:
+        pool = &VRAMPool;
+        page = search_vram_cache_page_by_vaddr(vaddr);
+        break;
+    default:
+        return false;
+    }
+    if (page == NULL) {
+        return false;
+    }
+
+    vmPolicy_touch(pool, page);
+    pool->hits++;
+    g_page_soft_fault_cnt++;
+    mmu_map_page(vaddr, page->PageOnPhyAddr,
+                 page->dirty ? AP_SYSRW_USRRW : AP_READONLY,
+                 VM_CACHE_ENABLE, VM_BUFFER_ENABLE);
+    if (fault->FSR == FSR_DATA_ACCESS_UNMAP_PAB)
+        mmu_invalidate_icache();
+    mmu_invalidate_tlb();
+    vTaskResume(fault->FaultTask);
+    g_vm_in_pagefault = false;
+#if VM_PROMOTE_PAGES
+    // Coming back from a CLOCK unmap that demoted it.
+    if (pool == &VROMPool) {
+        vrom_try_promote(vaddr);
+    }
+#endif
+    return true;
+}
+
+// Compress dirty VRAM pages ahead of eviction so that faults find clean victims.
+void vmMgr_writeback_task() {
+    CachePageInfo_t *page;
+
+    for (;;) {
+#if VM_WRITEBACK_ENABLE
+        xSemaphoreTake(VRAMPoolLock, portMAX_DELAY);
+        page = vmPolicy_peekDirty(&VRAMPool, VM_WRITEBACK_WINDOW);
+        if (page) {
+            // Drop the mapping first, a later access soft faults and a write marks it dirty again.
+            // Only then write back the lines, the guest can no longer dirty them behind us.
+            mmu_unmap_page(page->mapToVirtAddr);
+            mmu_invalidate_tlb();
+            mmu_clean_invalidated_dcache(page->mapToVirtAddr, PAGE_SIZE);
+            if (save_cache_page(page) == 0) {
+                g_page_writeback_cnt++;
+            } else {
+                page = NULL;
+            }
+        }
+        xSemaphoreGive(VRAMPoolLock);
+        if (page) {
+            continue;
+        }
+#endif
+        vTaskDelay(pdMS_TO_TICKS(VM_WRITEBACK_PERIOD_MS));
+    }
+}
+
 #else
 
 static inline __attribute__((target("thumb"))) void get_page_and_move_to_tail() {
@@ -486,14 +978,7 @@ static inline __attribute__((target("thumb"))) void move_cache_page_to_tail(Cach
 }
 
 static inline __attribute__((target("thumb"))) CachePageInfo_t *search_cache_page_by_vaddr(uint32_t vaddr) {
-    CachePageInfo_t *tmp = (CachePageInfo_t *)CachePageTail;
-    do {
-        if (tmp->mapToVirtAddr == vaddr) {
-            return tmp;
-        }
-        tmp = tmp->prev;
-    } while (tmp);
-    return NULL;
+    return cache_hash_find(CachePageHash, CACHE_HASH_MASK, vaddr);
 }
 
 #if USE_TINY_PAGE
@@ -577,6 +1062,8 @@ void vmMgr_ReleaseAllPage() {
     memset(CachePageTotal, 0, sizeof(CachePageTotal));
     memset(CachePageInfoVRAM, 0, sizeof(CachePageInfoVRAM));
     memset(CachePageInfoVROM, 0, sizeof(CachePageInfoVROM));
+    memset(CachePageVRAMHash, 0, sizeof(CachePageVRAMHash));
+    memset(CachePageVROMHash, 0, sizeof(CachePageVROMHash));
     for (int i = 0; i < NUM_CACHEPAGE_VROM; i++) {
         CachePageInfoVROM[i].dirty = false;
         CachePageInfoVROM[i].onPart = -1;
@@ -585,14 +1072,14 @@ void vmMgr_ReleaseAllPage() {
         CachePageInfoVROM[i].PageOnPhyAddr = CACHEVROM_PAGEn_BASE(i);
         CachePageInfoVROM[i].mapToVirtAddr = 0;
         CachePageInfoVROM[i].lock = false;
-        if (i > 0) {
-            CachePageInfoVROM[i - 1].next = &CachePageInfoVROM[i];
-            CachePageInfoVROM[i].prev = &CachePageInfoVROM[i - 1];
-        }
     }
 
-    CachePageVROMCur = CachePageVROMHead = &CachePageInfoVROM[0];
-    CachePageVROMTail = &CachePageInfoVROM[NUM_CACHEPAGE_VROM - 1];
+    vrom_nand_buf_page = 0xFFFFFFFF;
+    vrom_nand_buf_num = 0;
+    vrom_last_fault = 0;
+    vrom_ra_window = 0;
+    vmPolicy_init(&VROMPool, VM_REPLACE_POLICY_VROM, CachePageInfoVROM, NUM_CACHEPAGE_VROM, VROMGhost, NUM_CACHEPAGE_VROM / 2);
+    CachePageVROMCur = &CachePageInfoVROM[0];
 
     for (int i = 0; i < NUM_CACHEPAGE_VRAM; i++) {
         CachePageInfoVRAM[i].dirty = false;
@@ -602,14 +1089,10 @@ void vmMgr_ReleaseAllPage() {
         CachePageInfoVRAM[i].PageOnPhyAddr = CACHEVRAM_PAGEn_BASE(i);
         CachePageInfoVRAM[i].mapToVirtAddr = 0;
         CachePageInfoVRAM[i].lock = false;
-        if (i > 0) {
-            CachePageInfoVRAM[i - 1].next = &CachePageInfoVRAM[i];
-            CachePageInfoVRAM[i].prev = &CachePageInfoVRAM[i - 1];
-        }
     }
 
-    CachePageVRAMCur = CachePageVRAMHead = &CachePageInfoVRAM[0];
-    CachePageVRAMTail = &CachePageInfoVRAM[NUM_CACHEPAGE_VRAM - 1];
+    vmPolicy_init(&VRAMPool, VM_REPLACE_POLICY_VRAM, CachePageInfoVRAM, NUM_CACHEPAGE_VRAM, VRAMGhost, NUM_CACHEPAGE_VRAM / 2);
+    CachePageVRAMCur = &CachePageInfoVRAM[0];
 
     mmu_drain_buffer();
 
@@ -633,6 +1116,7 @@ void vmMgr_ReleaseAllPage() {
 void vmMgr_ReleaseAllPage() {
     memset(CachePage, 0, sizeof(CachePage));
     memset(CachePageInfo, 0, sizeof(CachePageInfo));
+    memset(CachePageHash, 0, sizeof(CachePageHash));
     for (int i = 0; i < NUM_CACHEPAGE; i++) {
         CachePageInfo[i].dirty = false;
         CachePageInfo[i].onPart = -1;
@@ -673,15 +1157,30 @@ void __attribute__((optimize("-Os"))) vmMgr_task() {
     pageFaultInfo_t currentFault;
     MapList_t *mapinfo;
 
+    uint32_t fault_t0;
+#if SEPARATE_VMM_CACHE
+    bool evict_dirty;
+#endif
+
     for (;;) {
         while (xQueueReceive(PageFaultQueue, &currentFault, portMAX_DELAY) == pdTRUE) {
+            if (currentFault.FSR == FSR_PREFETCH) {
+#if SEPARATE_VMM_CACHE
+                g_page_prefetch_cnt += vrom_load_range(currentFault.FaultMemAddr, currentFault.Len, VM_PREFETCH_MAX_PAGES);
+#endif
+                continue;
+            }
             vTaskSuspend(currentFault.FaultTask);
+            fault_t0 = HW_DIGCTL_MICROSECONDS_RD();
 
             VM_INFO("PAGE FAULT TASK [%s]. access %08x, FSR:%08x\n",
                     pcTaskGetName(currentFault.FaultTask), currentFault.FaultMemAddr, currentFault.FSR);
 
 #if USE_HARDWARE_DFLPT
             if (reload_DFLPT_seg(currentFault.FaultMemAddr >> 20) == 2) {
+                if ((currentFault.FaultMemAddr >> 20) < MAPLIST_INDEX_SEGS) {
+                    g_seg_dflpt_miss_cnt[currentFault.FaultMemAddr >> 20]++;
+                }
                 vTaskResume(currentFault.FaultTask);
                 continue;
             }
@@ -697,7 +1196,13 @@ void __attribute__((optimize("-Os"))) vmMgr_task() {
                 }
                 continue;
             }
+            if ((currentFault.FaultMemAddr >> 20) < MAPLIST_INDEX_SEGS) {
+                g_seg_fault_cnt[currentFault.FaultMemAddr >> 20]++;
+            }
 
+#if SEPARATE_VMM_CACHE
+            xSemaphoreTake(VRAMPoolLock, portMAX_DELAY);
+#endif
             switch (currentFault.FSR) {
             case FSR_DATA_ACCESS_UNMAP_PAB:
             case FSR_DATA_ACCESS_UNMAP_DAB: {
@@ -705,26 +1210,19 @@ void __attribute__((optimize("-Os"))) vmMgr_task() {
                 mapinfo = mapList_findVirtAddrInWhichMap(currentFault.FaultMemAddr);
                 if (mapinfo) {
 #if SEPARATE_VMM_CACHE
+                    if (vmMgr_softFault(&currentFault, mapinfo)) {
+                        break;
+                    }
                     switch (mapinfo->part) {
-                    case MAP_PART_RAWFLASH:
+                    case MAP_PART_RAWFLASH: {
+                        uint32_t vaddr = currentFault.FaultMemAddr & ~(PAGE_SIZE - 1);
                         g_page_vrom_fault_cnt++;
-                        get_vrom_page_and_move_to_tail();
-                        if (CachePageVROMCur->mapToVirtAddr) {
-                            mmu_unmap_page(CachePageVROMCur->mapToVirtAddr);
+                        CachePageVROMCur = vrom_load_page(mapinfo, vaddr, 1);
+                        if (CachePageVROMCur == NULL) {
+                            currentFault.FSR = FSR_UNKNOWN;
+                            taskAccessFaultAddr(&currentFault, "NO FREE VROM CACHE PAGE");
+                            break;
                         }
-                        CachePageVROMCur->mapToVirtAddr = currentFault.FaultMemAddr & ~(PAGE_SIZE - 1);
-                        CachePageVROMCur->onPart = mapinfo->part;
-                        CachePageVROMCur->onSector = mapinfo->PartStartSector + ((currentFault.FaultMemAddr - mapinfo->VMemStartAddr) & 0xFFFFFC00) / 2048;
-                        CachePageVROMCur->sectorOffset = (currentFault.FaultMemAddr / 1024) % 2 ? 1024 : 0;
-                        CachePageVROMCur->dirty = false;
-                        MTD_ReadPhyPage(CachePageVROMCur->onSector, CachePageVROMCur->sectorOffset, PAGE_SIZE, (uint8_t *)CachePageVROMCur->PageOnPhyAddr);
-
-                        mmu_map_page(
-                            CachePageVROMCur->mapToVirtAddr,
-                            CachePageVROMCur->PageOnPhyAddr,
-                            AP_READONLY,
-                            VM_CACHE_ENABLE,
-                            VM_BUFFER_ENABLE);
 
                         if (currentFault.FSR == FSR_DATA_ACCESS_UNMAP_DAB)
                             mmu_clean_invalidated_dcache(CachePageVROMCur->mapToVirtAddr, PAGE_SIZE);
@@ -734,11 +1232,37 @@ void __attribute__((optimize("-Os"))) vmMgr_task() {
                         // LL_CheckIRQAndTrap();
                         vTaskResume(currentFault.FaultTask);
                         g_vm_in_pagefault = false;
+
+                        // Sequential faults open the read-ahead window, anything else closes it.
+                        if ((vaddr > vrom_last_fault) && (vaddr <= vrom_last_fault + (vrom_ra_window + 2) * PAGE_SIZE)) {
+                            vrom_ra_window = vrom_ra_window ? vrom_ra_window * 2 : 1;
+                            if (vrom_ra_window > VM_READAHEAD_MAX_PAGES) {
+                                vrom_ra_window = VM_READAHEAD_MAX_PAGES;
+                            }
+                        } else {
+                            vrom_ra_window = 0;
+                        }
+                        vrom_last_fault = vaddr;
+                        if (vrom_ra_window) {
+                            g_page_readahead_cnt += vrom_load_range(vaddr + PAGE_SIZE, vrom_ra_window * PAGE_SIZE, vrom_ra_window);
+                        }
+#if VM_PROMOTE_PAGES
+                        for (uint32_t r = vaddr & ~(VM_PROMOTE_SIZE - 1); r <= vaddr + vrom_ra_window * PAGE_SIZE; r += VM_PROMOTE_SIZE) {
+                            vrom_try_promote(r);
+                        }
+#endif
                         break;
+                    }
 
                     case MAP_PART_FTL: {
                         g_page_vram_fault_cnt++;
-                        get_vram_page_and_move_to_tail();
+                        CachePageVRAMCur = vmPolicy_victim(&VRAMPool);
+                        if (CachePageVRAMCur == NULL) {
+                            currentFault.FSR = FSR_UNKNOWN;
+                            taskAccessFaultAddr(&currentFault, "NO FREE VRAM CACHE PAGE");
+                            break;
+                        }
+                        evict_dirty = CachePageVRAMCur->dirty;
                         int ret = save_cache_page((CachePageInfo_t *)CachePageVRAMCur);
                         if(ret == -2)
                         {
@@ -754,14 +1278,17 @@ void __attribute__((optimize("-Os"))) vmMgr_task() {
                         if (CachePageVRAMCur->mapToVirtAddr) {
                             mmu_unmap_page(CachePageVRAMCur->mapToVirtAddr);
                         }
-                        CachePageVRAMCur->mapToVirtAddr = currentFault.FaultMemAddr & ~(PAGE_SIZE - 1);
+                        cache_hash_remap(CachePageVRAMHash, VRAM_HASH_MASK, (CachePageInfo_t *)CachePageVRAMCur, currentFault.FaultMemAddr & ~(PAGE_SIZE - 1));
                         CachePageVRAMCur->onPart = mapinfo->part;
                         CachePageVRAMCur->onSector = mapinfo->PartStartSector + ((currentFault.FaultMemAddr - mapinfo->VMemStartAddr) & 0xFFFFFC00) / 2048;
                         CachePageVRAMCur->sectorOffset = (currentFault.FaultMemAddr / 1024) % 2 ? 1024 : 0;
                         CachePageVRAMCur->dirty = false;
+                        vmPolicy_insert(&VRAMPool, (CachePageInfo_t *)CachePageVRAMCur);
                         uint32_t zram_ind = (CachePageVRAMCur->onSector * 2048 + CachePageVRAMCur->sectorOffset) / PAGE_SIZE;
                         if ((zram_ind < (ZRAM_COMPRESSED_SIZE / PAGE_SIZE))) {
-                            if (ZRAMAddress_Tab[zram_ind]) {
+                            if (ZRAM_IS_FILLED(ZRAMAddress_Tab[zram_ind])) {
+                                zram_restore_same_filled((uint32_t *)CachePageVRAMCur->PageOnPhyAddr, ZRAM_FILL_DECODE(ZRAMAddress_Tab[zram_ind]));
+                            } else if (ZRAMAddress_Tab[zram_ind]) {
 // memset((void *)CachePageVRAMCur->PageOnPhyAddr, 0, PAGE_SIZE);
 // printf("free:%d\n", zram_ind);
 // cdmp_read(ZRAMAddress_Tab[zram_ind], 0, PAGE_SIZE, (void *)CachePageVRAMCur->PageOnPhyAddr);
@@ -772,20 +1299,12 @@ void __attribute__((optimize("-Os"))) vmMgr_task() {
                                 qlz_decompress(cdmp_get_memblock(ZRAMAddress_Tab[zram_ind]), (void *)CachePageVRAMCur->PageOnPhyAddr, (qlz_state_decompress *)&decomp_state);
 #endif
 #if MEM_COMPRESSION_ALGORITHM == MINILZO
-                                uint32_t sz;
                                 //int ret = lzo1x_decompress(cdmp_get_memblock(ZRAMAddress_Tab[zram_ind]),
                                 //                           cdmp_memblock_size(ZRAMAddress_Tab[zram_ind]),
                                 //                           (void *)CachePageVRAMCur->PageOnPhyAddr, &sz, NULL);
-                                int ret = lzo1x_decompress(((void *)ZRAMAddress_Tab[zram_ind]),
-                                                           PAGE_SIZE,
-                                                           (void *)CachePageVRAMCur->PageOnPhyAddr, &sz, NULL);
-                                if ((ret == LZO_E_OK) || (ret == LZO_E_INPUT_NOT_CONSUMED) || (ret == LZO_E_INPUT_OVERRUN)) {
-
-                                } else {
-                                    printf("DECOMP ERR:%d\n", ret);
-                                    while (1)
-                                        ;
-                                }
+                                zram_decode(ZRAM_BLOCK(ZRAMAddress_Tab[zram_ind]), PAGE_SIZE,
+                                            ZRAM_CODEC(ZRAMAddress_Tab[zram_ind]),
+                                            (uint8_t *)CachePageVRAMCur->PageOnPhyAddr);
 #endif
 #if MEM_COMPRESSION_ALGORITHM == NONE
                                 cdmp_read(ZRAMAddress_Tab[zram_ind], 0, PAGE_SIZE, (void *)CachePageVRAMCur->PageOnPhyAddr);
@@ -800,12 +1319,13 @@ void __attribute__((optimize("-Os"))) vmMgr_task() {
                                 // printf("new page:%ld\n", zram_ind);
                             }
                         } else {
-                            if (mem_swap_enable) {
-                                FTL_ReadSector(CachePageVRAMCur->onSector, 1, (uint8_t *)compress_buffer);
-                                memcpy((uint8_t *)CachePageVRAMCur->PageOnPhyAddr, (void *)((uint32_t)compress_buffer + CachePageVRAMCur->sectorOffset), PAGE_SIZE);
-
+                            uint32_t len, codec;
+                            const uint8_t *blob = vmSwap_fetch(zram_ind - (ZRAM_COMPRESSED_SIZE / PAGE_SIZE), (uint8_t *)compress_buffer, &len, &codec);
+                            if (blob) {
+                                zram_decode(blob, len, codec, (uint8_t *)CachePageVRAMCur->PageOnPhyAddr);
                             } else {
-                                printf("FROM SWAP AREA!!\n");
+                                // Never swapped out.
+                                memset((void *)CachePageVRAMCur->PageOnPhyAddr, 0, PAGE_SIZE);
                             }
                         }
 
@@ -816,14 +1336,23 @@ void __attribute__((optimize("-Os"))) vmMgr_task() {
                             VM_CACHE_ENABLE,
                             VM_BUFFER_ENABLE);
 
+                        uint32_t around = vram_fault_around(mapinfo, (CachePageInfo_t *)CachePageVRAMCur);
+
                         if (currentFault.FSR == FSR_DATA_ACCESS_UNMAP_DAB)
-                            mmu_clean_invalidated_dcache(CachePageVRAMCur->mapToVirtAddr, PAGE_SIZE);
+                            mmu_clean_invalidated_dcache(CachePageVRAMCur->mapToVirtAddr, (around + 1) * PAGE_SIZE);
                         if (currentFault.FSR == FSR_DATA_ACCESS_UNMAP_PAB)
                             mmu_invalidate_icache();
                         mmu_invalidate_tlb();
                         // LL_CheckIRQAndTrap();
                         vTaskResume(currentFault.FaultTask);
                         g_vm_in_pagefault = false;
+                        if (evict_dirty) {
+                            g_page_evict_dirty_cnt++;
+                            g_page_evict_dirty_us += HW_DIGCTL_MICROSECONDS_RD() - fault_t0;
+                        } else {
+                            g_page_evict_clean_cnt++;
+                            g_page_evict_clean_us += HW_DIGCTL_MICROSECONDS_RD() - fault_t0;
+                        }
                         break;
 
                     } break;
@@ -840,13 +1369,13 @@ void __attribute__((optimize("-Os"))) vmMgr_task() {
                         mmu_unmap_page(CachePageCur->mapToVirtAddr);
                     }
 #if USE_TINY_PAGE
-                    CachePageCur->mapToVirtAddr = currentFault.FaultMemAddr & ~(PAGE_SIZE - 1);
+                    cache_hash_remap(CachePageHash, CACHE_HASH_MASK, (CachePageInfo_t *)CachePageCur, currentFault.FaultMemAddr & ~(PAGE_SIZE - 1));
                     CachePageCur->onPart = mapinfo->part;
                     CachePageCur->onSector = mapinfo->PartStartSector + ((currentFault.FaultMemAddr - mapinfo->VMemStartAddr) & 0xFFFFFC00) / 2048;
                     CachePageCur->sectorOffset = (currentFault.FaultMemAddr / 1024) % 2 ? 1024 : 0;
                     CachePageCur->dirty = false;
 #else
-                    CachePageCur->mapToVirtAddr = currentFault.FaultMemAddr & 0xFFFFF000;
+                    cache_hash_remap(CachePageHash, CACHE_HASH_MASK, (CachePageInfo_t *)CachePageCur, currentFault.FaultMemAddr & 0xFFFFF000);
                     CachePageCur->onPart = mapinfo->part;
                     CachePageCur->onSector = mapinfo->PartStartSector + ((currentFault.FaultMemAddr - mapinfo->VMemStartAddr) & 0xFFFFF000) / 2048;
                     CachePageCur->dirty = false;
@@ -936,7 +1465,7 @@ void __attribute__((optimize("-Os"))) vmMgr_task() {
                         if (gotCache) {
                             // INFO("Get:%08x\n", gotCache->mapToVirtAddr);
                             gotCache->dirty = true;
-                            move_vram_cache_page_to_tail(gotCache);
+                            vmPolicy_touch(&VRAMPool, gotCache);
                             mmu_unmap_page(gotCache->mapToVirtAddr);
                             mmu_map_page(gotCache->mapToVirtAddr,
                                          gotCache->PageOnPhyAddr,
@@ -993,6 +1522,9 @@ void __attribute__((optimize("-Os"))) vmMgr_task() {
                 VM_ERR("Unknown Task Fault Reason.\n");
                 break;
             }
+#if SEPARATE_VMM_CACHE
+            xSemaphoreGive(VRAMPoolLock);
+#endif
             swapping = 0;
         }
     }
@@ -1001,10 +1533,12 @@ void __attribute__((optimize("-Os"))) vmMgr_task() {
 void vmMgr_init() {
     PageFaultQueue = xQueueCreate(32, sizeof(pageFaultInfo_t));
 #if SEPARATE_VMM_CACHE
+    VRAMPoolLock = xSemaphoreCreateMutex();
     //cdmp_mem_init(ZRAM, sizeof(ZRAM));
     //tlsf_pool = tlsf_create_with_pool(ZRAM, sizeof(ZRAM));
     init_memory_pool(sizeof(ZRAM), ZRAM);
     memset(ZRAMAddress_Tab, 0, sizeof(ZRAMAddress_Tab));
+    vmSwap_init();
 #endif
     mapListInit();
     mmu_init();
@@ -28,6 +28,7 @@
 #define    FSR_INST_FETCH               5
 #define    FSR_ZRAM_OOM                 6
 #define    FSR_SWAP_NOTENABLE           7
+#define    FSR_PREFETCH                 8       // not a fault, FaultMemAddr/Len is a range to load ahead
 #define    FSR_UNKNOWN                  0xF
 
 typedef struct pageFaultInfo_t
@@ -36,12 +37,14 @@ typedef struct pageFaultInfo_t
     uint32_t FaultMemAddr;
     uint32_t FSR;
     uint32_t FaultPC;
+    uint32_t Len;
 }pageFaultInfo_t;
 
 extern QueueHandle_t PageFaultQueue;
 
 void vmMgr_init(void);
 void vmMgr_task(void);
+void vmMgr_writeback_task(void);
 bool vmMgrInited(void);
 void vmMgr_mapSwap(void);
 
@@ -52,6 +55,7 @@ bool vmMgr_checkAddressValid(uint32_t address, uint32_t perm);
 void vmMgr_ReleaseAllPage();
 
 void zram_info(uint32_t *free, uint32_t *total);
+uint32_t zram_frag_info(void);
 //uint32_t vmMgr_getMountPhyAddressAndLock(uint32_t vaddr, uint32_t perm);
 
 
@@ -0,0 +1,277 @@
+
+#include <string.h>
+
+#include "SystemConfig.h"
+#include "mmu.h"
+#include "vmPolicy.h"
+
+#if SEPARATE_VMM_CACHE
+
+static inline void list_unlink(CachePageInfo_t **head, CachePageInfo_t **tail, CachePageInfo_t *item) {
+    if (item->prev) {
+        item->prev->next = item->next;
+    } else {
+        *head = item->next;
+    }
+    if (item->next) {
+        item->next->prev = item->prev;
+    } else {
+        *tail = item->prev;
+    }
+    item->prev = NULL;
+    item->next = NULL;
+}
+
+static inline void list_push_tail(CachePageInfo_t **head, CachePageInfo_t **tail, CachePageInfo_t *item) {
+    item->next = NULL;
+    item->prev = *tail;
+    if (*tail) {
+        (*tail)->next = item;
+    } else {
+        *head = item;
+    }
+    *tail = item;
+}
+
+static inline void queue_unlink(CachePool_t *pool, CachePageInfo_t *item) {
+    if (item->queue == VM_QUEUE_A1IN) {
+        list_unlink(&pool->a1Head, &pool->a1Tail, item);
+        pool->a1Num--;
+    } else {
+        list_unlink(&pool->head, &pool->tail, item);
+    }
+}
+
+void vmPolicy_init(CachePool_t *pool, uint32_t policy, CachePageInfo_t *pages, uint32_t num, uint32_t *ghost, uint32_t ghostNum) {
+    memset(pool, 0, sizeof(CachePool_t));
+    pool->policy = policy;
+    pool->pages = pages;
+    pool->num = num;
+    pool->ghost = ghost;
+    pool->ghostNum = ghostNum;
+    if (ghost) {
+        memset(ghost, 0, ghostNum * sizeof(uint32_t));
+    }
+
+    for (int i = 0; i < num; i++) {
+        pages[i].referenced = false;
+        if (policy == VM_POLICY_2Q) {
+            // Empty pages sit in A1in so they are consumed first.
+            pages[i].queue = VM_QUEUE_A1IN;
+            list_push_tail(&pool->a1Head, &pool->a1Tail, &pages[i]);
+            pool->a1Num++;
+        } else {
+            pages[i].queue = VM_QUEUE_AM;
+            list_push_tail(&pool->head, &pool->tail, &pages[i]);
+        }
+    }
+}
+
+// NULL when every page is locked.
+static CachePageInfo_t *clock_victim(CachePool_t *pool) {
+    CachePageInfo_t *p = NULL;
+    bool unmapped = false;
+    for (int n = 0; n < pool->num * 2; n++) {
+        p = &pool->pages[pool->hand];
+        if (++pool->hand >= pool->num) {
+            pool->hand = 0;
+        }
+        if (p->lock) {
+            continue;
+        }
+        if (p->referenced && p->mapToVirtAddr) {
+            // Second chance: drop the mapping, the next access soft faults and sets it again.
+            p->referenced = false;
+            mmu_clean_dcache(p->mapToVirtAddr, PAGE_SIZE);
+            mmu_unmap_page(p->mapToVirtAddr);
+            unmapped = true;
+            p = NULL;
+            continue;
+        }
+        break;
+    }
+    if (unmapped) {
+        // Referenced bits are only set again if the next access really faults.
+        mmu_invalidate_tlb();
+    }
+    if (p && p->lock) {
+        p = NULL;
+    }
+    return p;
+}
+
+static CachePageInfo_t *twoq_victim(CachePool_t *pool) {
+    CachePageInfo_t *p;
+    uint32_t kin = pool->num / 4 ? pool->num / 4 : 1;
+
+    if ((pool->a1Num > kin) || (pool->head == NULL)) {
+        p = pool->a1Head;
+        while (p && p->lock) {
+            p = p->next;
+        }
+        if (p) {
+            if (p->mapToVirtAddr && pool->ghost) {
+                pool->ghost[pool->ghostPtr++] = p->mapToVirtAddr;
+                if (pool->ghostPtr >= pool->ghostNum) {
+                    pool->ghostPtr = 0;
+                }
+            }
+            return p;
+        }
+    }
+    p = pool->head;
+    while (p && p->lock) {
+        p = p->next;
+    }
+    if (p == NULL) {
+        for (p = pool->a1Head; p && p->lock; p = p->next)
+            ;
+    }
+    return p;
+}
+
+CachePageInfo_t *vmPolicy_victim(CachePool_t *pool) {
+    CachePageInfo_t *p;
+
+    pool->evictions++;
+    switch (pool->policy) {
+    case VM_POLICY_CLOCK:
+        return clock_victim(pool);
+    case VM_POLICY_2Q:
+        return twoq_victim(pool);
+    case VM_POLICY_FIFO:
+    default:
+        p = pool->head;
+        list_unlink(&pool->head, &pool->tail, p);
+        list_push_tail(&pool->head, &pool->tail, p);
+        return p;
+    }
+}
+
+// Called once the victim has been rebound to its new vaddr.
+void vmPolicy_insert(CachePool_t *pool, CachePageInfo_t *page) {
+    switch (pool->policy) {
+    case VM_POLICY_CLOCK:
+        page->referenced = true;
+        break;
+    case VM_POLICY_2Q:
+        queue_unlink(pool, page);
+        for (int i = 0; i < pool->ghostNum; i++) {
+            if (pool->ghost[i] == page->mapToVirtAddr) {
+                pool->ghost[i] = 0;
+                page->queue = VM_QUEUE_AM;
+                list_push_tail(&pool->head, &pool->tail, page);
+                return;
+            }
+        }
+        page->queue = VM_QUEUE_A1IN;
+        list_push_tail(&pool->a1Head, &pool->a1Tail, page);
+        pool->a1Num++;
+        break;
+    default:
+        break;
+    }
+}
+
+// The page vmPolicy_victim() would return, without changing the replacement state.
+CachePageInfo_t *vmPolicy_peekVictim(CachePool_t *pool) {
+    CachePageInfo_t *p;
+    uint32_t hand;
+    uint32_t kin;
+
+    switch (pool->policy) {
+    case VM_POLICY_CLOCK:
+        hand = pool->hand;
+        for (uint32_t n = 0; n < pool->num; n++) {
+            p = &pool->pages[hand];
+            if (!p->lock && !(p->referenced && p->mapToVirtAddr)) {
+                return p;
+            }
+            if (++hand >= pool->num) {
+                hand = 0;
+            }
+        }
+        return NULL;
+    case VM_POLICY_2Q:
+        kin = pool->num / 4 ? pool->num / 4 : 1;
+        if ((pool->a1Num > kin) || (pool->head == NULL)) {
+            for (p = pool->a1Head; p && p->lock; p = p->next)
+                ;
+            if (p) {
+                return p;
+            }
+        }
+        for (p = pool->head; p && p->lock; p = p->next)
+            ;
+        if (p == NULL) {
+            for (p = pool->a1Head; p && p->lock; p = p->next)
+                ;
+        }
+        return p;
+    case VM_POLICY_FIFO:
+    default:
+        return pool->head;
+    }
+}
+
+static CachePageInfo_t *first_dirty(CachePageInfo_t *p, uint32_t *window) {
+    for (; p && *window; p = p->next, (*window)--) {
+        if (p->dirty && !p->lock) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+// Look for a dirty page among the next `window` eviction candidates,
+// without changing the replacement state.
+CachePageInfo_t *vmPolicy_peekDirty(CachePool_t *pool, uint32_t window) {
+    CachePageInfo_t *p;
+    uint32_t hand;
+
+    switch (pool->policy) {
+    case VM_POLICY_CLOCK:
+        hand = pool->hand;
+        for (uint32_t n = 0; (n < window) && (n < pool->num); n++) {
+            p = &pool->pages[hand];
+            if (p->dirty && !p->lock) {
+                return p;
+            }
+            if (++hand >= pool->num) {
+                hand = 0;
+            }
+        }
+        return NULL;
+    case VM_POLICY_2Q:
+        p = first_dirty(pool->a1Head, &window);
+        if (p) {
+            return p;
+        }
+        return first_dirty(pool->head, &window);
+    case VM_POLICY_FIFO:
+    default:
+        return first_dirty(pool->head, &window);
+    }
+}
+
+void vmPolicy_touch(CachePool_t *pool, CachePageInfo_t *page) {
+    switch (pool->policy) {
+    case VM_POLICY_CLOCK:
+        page->referenced = true;
+        break;
+    case VM_POLICY_2Q:
+        // Hits in A1in are ignored, only pages coming back from A1out are promoted.
+        if (page->queue == VM_QUEUE_AM) {
+            list_unlink(&pool->head, &pool->tail, page);
+            list_push_tail(&pool->head, &pool->tail, page);
+        }
+        break;
+    case VM_POLICY_FIFO:
+    default:
+        list_unlink(&pool->head, &pool->tail, page);
+        list_push_tail(&pool->head, &pool->tail, page);
+        break;
+    }
+}
+
+#endif
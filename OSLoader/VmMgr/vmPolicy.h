@@ -0,0 +1,59 @@
+#ifndef __VMPOLICY_H__
+#define __VMPOLICY_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "SystemConfig.h"
+
+// VM_POLICY_FIFO / VM_POLICY_CLOCK / VM_POLICY_2Q are selected in SystemConfig.h
+// CLOCK: second chance, referenced bit emulated by unmapping
+// 2Q:    A1in FIFO + Am LRU + A1out ghost list
+
+#define VM_QUEUE_AM         0
+#define VM_QUEUE_A1IN       1
+
+typedef struct CachePageInfo_t {
+    struct CachePageInfo_t *prev;
+    struct CachePageInfo_t *next;
+    struct CachePageInfo_t *hnext;  // next page in the same vaddr hash bucket
+    uint32_t mapToVirtAddr;
+    uint32_t PageOnPhyAddr;
+    uint32_t onPart;
+    uint32_t onSector;
+    uint32_t sectorOffset;
+    bool dirty;
+    bool lock;
+    bool referenced;
+    uint8_t queue;
+} CachePageInfo_t;
+
+typedef struct CachePool_t {
+    uint32_t policy;
+    CachePageInfo_t *pages;
+    uint32_t num;
+
+    CachePageInfo_t *head;          // FIFO order / 2Q Am (LRU at head)
+    CachePageInfo_t *tail;
+
+    CachePageInfo_t *a1Head;        // 2Q A1in
+    CachePageInfo_t *a1Tail;
+    uint32_t a1Num;
+    uint32_t *ghost;                // 2Q A1out, vaddrs recently evicted from A1in
+    uint32_t ghostNum;
+    uint32_t ghostPtr;
+
+    uint32_t hand;                  // CLOCK
+
+    uint32_t hits;                  // soft faults served from the pool
+    uint32_t evictions;
+} CachePool_t;
+
+void vmPolicy_init(CachePool_t *pool, uint32_t policy, CachePageInfo_t *pages, uint32_t num, uint32_t *ghost, uint32_t ghostNum);
+CachePageInfo_t *vmPolicy_victim(CachePool_t *pool);
+CachePageInfo_t *vmPolicy_peekVictim(CachePool_t *pool);
+void vmPolicy_insert(CachePool_t *pool, CachePageInfo_t *page);
+void vmPolicy_touch(CachePool_t *pool, CachePageInfo_t *page);
+CachePageInfo_t *vmPolicy_peekDirty(CachePool_t *pool, uint32_t window);
+
+#endif
@@ -0,0 +1,152 @@
+
+#include <string.h>
+
+#include "SystemConfig.h"
+#include "FTL_up.h"
+#include "vmSwap.h"
+
+#include "../debug.h"
+
+#if SEPARATE_VMM_CACHE
+
+#define SWAP_NONE               (0xFFFF)
+#define SWAP_ENT(sec, slot)     (((sec) << 4) | (slot))
+#define SWAP_ENT_SEC(e)         ((e) >> 4)
+#define SWAP_ENT_SLOT(e)        ((e) & 0xF)
+
+// Live slots per sector, two sectors per byte.
+#define LIVE_GET(s)             ((SwapLive[(s) / 2] >> (((s) & 1) * 4)) & 0xF)
+#define LIVE_SET(s, v)          (SwapLive[(s) / 2] = (SwapLive[(s) / 2] & ~(0xF << (((s) & 1) * 4))) | ((v) << (((s) & 1) * 4)))
+
+static uint16_t SwapIndex_Tab[VM_SWAP_PAGES];
+static uint8_t SwapLive[(VM_SWAP_LOG_SECTORS + 1) / 2];
+
+// Sector being filled, it is only written to the FTL once full.
+static uint32_t swap_wbuf[VM_SWAP_SECTOR_SIZE / sizeof(uint32_t)];
+static SwapSectorHdr_t *swap_whdr = (SwapSectorHdr_t *)swap_wbuf;
+static uint32_t swap_wsector;
+static uint32_t swap_wused;
+
+uint32_t g_swap_pages_out = 0;
+uint32_t g_swap_pages_in = 0;
+uint32_t g_swap_sector_writes = 0;
+uint32_t g_swap_write_errors = 0;
+
+static void swap_open_sector(uint32_t from) {
+    uint32_t s = from;
+    // At most one page per sector is live in the worst case, VM_SWAP_LOG_SECTORS > VM_SWAP_PAGES keeps one free.
+    while (LIVE_GET(s)) {
+        if (++s >= VM_SWAP_LOG_SECTORS) {
+            s = 0;
+        }
+    }
+    swap_wsector = s;
+    swap_wused = sizeof(SwapSectorHdr_t);
+    memset(swap_whdr, 0, sizeof(SwapSectorHdr_t));
+}
+
+// On a write error the sector stays open, its pages are still served from swap_wbuf.
+static int swap_flush() {
+    int ret = 0;
+    if (LIVE_GET(swap_wsector)) {
+        ret = FTL_WriteSector(VM_SWAP_LOG_START + swap_wsector, 1, (uint8_t *)swap_wbuf);
+        if (ret) {
+            g_swap_write_errors++;
+            printf("SWAP WRITE FAIL:%ld\n", swap_wsector);
+            return ret;
+        }
+        g_swap_sector_writes++;
+        swap_open_sector(swap_wsector + 1 >= VM_SWAP_LOG_SECTORS ? 0 : swap_wsector + 1);
+    } else {
+        // Everything in it died before it was written, reuse it.
+        swap_open_sector(swap_wsector);
+    }
+    return ret;
+}
+
+static void swap_release(uint32_t page) {
+    uint16_t e = SwapIndex_Tab[page];
+    uint32_t s;
+    if (e == SWAP_NONE) {
+        return;
+    }
+    s = SWAP_ENT_SEC(e);
+    LIVE_SET(s, LIVE_GET(s) - 1);
+    if ((LIVE_GET(s) == 0) && (s != swap_wsector)) {
+        FTL_TrimSector(VM_SWAP_LOG_START + s);
+    }
+    SwapIndex_Tab[page] = SWAP_NONE;
+}
+
+void vmSwap_init() {
+    memset(SwapIndex_Tab, 0xFF, sizeof(SwapIndex_Tab));
+    memset(SwapLive, 0, sizeof(SwapLive));
+    swap_open_sector(0);
+}
+
+int vmSwap_store(uint32_t page, const void *blob, uint32_t len, uint32_t codec) {
+    SwapSlot_t *slot;
+    int ret = 0;
+
+    if (page >= VM_SWAP_PAGES) {
+        return -1;
+    }
+
+    if ((swap_whdr->count >= VM_SWAP_SLOTS) || (swap_wused + len > VM_SWAP_SECTOR_SIZE)) {
+        // Nothing is stored then, the caller keeps the page and its previous copy stays valid.
+        ret = swap_flush();
+        if (ret) {
+            return ret;
+        }
+    }
+    swap_release(page);
+
+    slot = &swap_whdr->slot[swap_whdr->count];
+    slot->page = page;
+    slot->offset = swap_wused;
+    slot->len = len;
+    slot->codec = codec;
+    memcpy((uint8_t *)swap_wbuf + swap_wused, blob, len);
+    swap_wused += (len + 3) & ~3;
+
+    SwapIndex_Tab[page] = SWAP_ENT(swap_wsector, swap_whdr->count);
+    LIVE_SET(swap_wsector, LIVE_GET(swap_wsector) + 1);
+    swap_whdr->count++;
+    g_swap_pages_out++;
+    return ret;
+}
+
+// Returns the stored blob of `page`, either in the open sector or read into `secbuf`,
+// NULL if the page never went to swap.
+const uint8_t *vmSwap_fetch(uint32_t page, uint8_t *secbuf, uint32_t *len, uint32_t *codec) {
+    uint16_t e;
+    SwapSectorHdr_t *hdr;
+    SwapSlot_t *slot;
+
+    if (page >= VM_SWAP_PAGES) {
+        return NULL;
+    }
+    e = SwapIndex_Tab[page];
+    if (e == SWAP_NONE) {
+        return NULL;
+    }
+    if (SWAP_ENT_SEC(e) == swap_wsector) {
+        hdr = swap_whdr;
+    } else {
+        if (FTL_ReadSector(VM_SWAP_LOG_START + SWAP_ENT_SEC(e), 1, secbuf) < 0) {
+            return NULL;
+        }
+        hdr = (SwapSectorHdr_t *)secbuf;
+    }
+    slot = &hdr->slot[SWAP_ENT_SLOT(e)];
+    if (slot->page != page) {
+        printf("SWAP INDEX BROKEN:%ld\n", page);
+        return NULL;
+    }
+    *len = slot->len;
+    *codec = slot->codec;
+    g_swap_pages_in++;
+    return (uint8_t *)hdr + slot->offset;
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef __VMSWAP_H__
+#define __VMSWAP_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "SystemConfig.h"
+
+// Log structured swap for VRAM pages that do not fit in ZRAM.
+// Compressed pages are packed into 2 KB FTL sectors, a sector is written once
+// it is full and trimmed once none of its slots is live any more.
+
+#define VM_SWAP_SECTOR_SIZE     (2048)
+#define VM_SWAP_SLOTS           (8)         // pages packed per sector at most
+
+typedef struct SwapSlot_t {
+    uint16_t page;
+    uint16_t offset;
+    uint16_t len;
+    uint8_t codec;
+    uint8_t rsv;
+} SwapSlot_t;
+
+typedef struct SwapSectorHdr_t {
+    uint16_t count;
+    uint16_t rsv;
+    SwapSlot_t slot[VM_SWAP_SLOTS];
+} SwapSectorHdr_t;
+
+void vmSwap_init(void);
+int vmSwap_store(uint32_t page, const void *blob, uint32_t len, uint32_t codec);
+const uint8_t *vmSwap_fetch(uint32_t page, uint8_t *secbuf, uint32_t *len, uint32_t *codec);
+
+#endif
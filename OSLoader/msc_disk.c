@@ -337,6 +337,13 @@ int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void *buff
             #else
             MTD_ReadPhyPage(lba, offset, bufsize, buffer);
             #endif
+            }else if((bufsize % 2048) == 0){
+            // Whole sectors, read them with one request so the FTL can batch the flash pages.
+            #ifndef RAW_FLASH_ACCESS
+            FTL_ReadSector(FLASH_FTL_DATA_SECTOR + lba, bufsize / 2048, buffer);
+            #else
+            MTD_ReadPhyPages(lba, bufsize / 2048, buffer);
+            #endif
             }else{
                 printf("RD:lba=%ld, off:%ld, len:%ld\n",lba, offset, bufsize);
             }
@@ -400,7 +407,7 @@ int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t *
     case MSC_CONF_SYS_DATA:
         //printf("WR:lba%d, off:%d, len:%d\n",lba, offset, bufsize);
         //FTL_WriteSector(FLASH_FTL_DATA_SECTOR + lba, 1, buffer);
-        if(bufsize ==  2048)
+        if((bufsize % 2048) == 0)
         {/*
             if (last_lba != lba) {
                 FTL_ReadSector(FLASH_FTL_DATA_SECTOR + lba, 1, MSCWRBuf);
@@ -414,9 +421,9 @@ int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t *
             //MTD_WritePhyPage(lba, buffer);
             
             #ifndef RAW_FLASH_ACCESS
-            FTL_WriteSector(FLASH_FTL_DATA_SECTOR + lba, 1, buffer);
+            FTL_WriteSector(FLASH_FTL_DATA_SECTOR + lba, bufsize / 2048, buffer);
             #else
-            MTD_WritePhyPage(lba, buffer);
+            MTD_WritePhyPages(lba, bufsize / 2048, buffer);
             #endif
             
         }else{
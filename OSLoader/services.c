@@ -38,6 +38,7 @@ void vTaskTinyUSB(void *pvParameters)
 void vMTDSvc(void *pvParameters)
 {
   MTD_DeviceInit();
+  boardBootStage(BOOT_STAGE_MTD);
   for(;;)
     MTD_Task();
 }
@@ -45,6 +46,7 @@ void vMTDSvc(void *pvParameters)
 void vFTLSvc(void *pvParameters)
 {
   g_FTL_status = FTL_init();
+  boardBootStage(BOOT_STAGE_FTL);
   for(;;)
     FTL_task();
 }
@@ -63,12 +65,25 @@ void vVMMgrSvc(void *pvParameters)
 {
   //vTaskDelay(pdMS_TO_TICKS(10));
   vmMgr_init();
+  boardBootStage(BOOT_STAGE_VM);
   g_vm_inited = true;
   for(;;){
     vmMgr_task();
   }
 }
 
+#if SEPARATE_VMM_CACHE
+void vVMWritebackSvc(void *pvParameters)
+{
+  while(!g_vm_inited){
+    vTaskDelay(pdMS_TO_TICKS(10));
+  }
+  for(;;){
+    vmMgr_writeback_task();
+  }
+}
+#endif
+
 void vLLAPISvc(void *pvParameters)
 {
   LLAPI_init(pSysTask);
@@ -16,6 +16,7 @@
 #include "keyboard_up.h"
 #include "llapi.h"
 #include "llapi_code.h"
+#include "mapList.h"
 #include "mtd_up.h"
 #include "rtc_up.h"
 #include "vmMgr.h"
@@ -37,6 +38,7 @@ void vMTDSvc(void *pvParameters);
 void vFTLSvc(void *pvParameters);
 void vKeysSvc(void *pvParameters);
 void vVMMgrSvc(void *pvParameters);
+void vVMWritebackSvc(void *pvParameters);
 void vLLAPISvc(void *pvParameters);
 void vDispSvc(void *pvParameters);
 
@@ -52,10 +54,24 @@ TaskHandle_t pBattmon = NULL;
 TaskHandle_t pMainThread = NULL;
 
 extern uint32_t g_mtd_write_cnt;
+extern uint32_t g_mtd_lat_hist[MTD_LAT_CLASSES][MTD_LAT_BUCKETS];
+extern uint32_t g_mtd_wait_us;
 extern uint32_t g_mtd_read_cnt;
 extern uint32_t g_mtd_erase_cnt;
 extern uint32_t g_mtd_ecc_cnt;
 extern uint32_t g_mtd_ecc_fatal_cnt;
+extern uint32_t g_ftl_idle_gc_cnt;
+extern uint32_t g_ftl_copy_cnt;
+extern uint32_t g_ftl_copy_us;
+extern uint32_t g_ftl_sector_writes;
+extern uint32_t g_ftl_wcache_absorbed;
+extern uint32_t g_ftl_scrub_cnt;
+extern uint32_t g_ftl_scrub_raw;
+extern uint32_t g_mtd_scrub_marked;
+extern uint32_t g_ftl_mount_us;
+extern bool g_ftl_mount_fast;
+extern uint32_t g_ftl_mount_reads;
+extern uint32_t g_ftl_bbt_hits;
 
 uint32_t CurMount = 0;
 uint32_t g_FTL_status = 10;
@@ -70,6 +86,29 @@ uint32_t HCLK_Freq;
 
 extern uint32_t g_page_vram_fault_cnt;
 extern uint32_t g_page_vrom_fault_cnt;
+extern uint32_t g_page_soft_fault_cnt;
+extern uint32_t g_page_compress_cnt;
+extern uint32_t g_page_raw_cnt;
+extern uint32_t g_zram_frag;
+extern uint32_t g_zram_compact_cnt;
+extern uint32_t g_zram_compact_moved;
+extern uint32_t g_swap_pages_out;
+extern uint32_t g_swap_pages_in;
+extern uint32_t g_swap_sector_writes;
+extern uint32_t g_swap_write_errors;
+extern uint32_t g_page_writeback_cnt;
+extern uint32_t g_page_readahead_cnt;
+extern uint32_t g_page_prefetch_cnt;
+extern uint32_t g_page_fault_around_cnt;
+extern uint32_t g_page_evict_clean_cnt;
+extern uint32_t g_page_evict_dirty_cnt;
+extern uint32_t g_page_evict_clean_us;
+extern uint32_t g_page_evict_dirty_us;
+extern uint32_t g_page_promote_cnt;
+extern uint32_t g_page_promote_moved;
+extern uint32_t g_mmu_demote_cnt;
+extern uint32_t g_seg_dflpt_miss_cnt[];
+extern uint32_t g_seg_fault_cnt[];
 
 uint32_t g_core_temp, g_batt_volt;
 uint32_t g_core_cur_freq_mhz = 1;
@@ -85,6 +124,8 @@ uint32_t check_frequency() {
 float mem_cr = 0;
 uint32_t g_mem_comp_rate[16];
 uint32_t g_mem_comp_rate_ptr = 0;
+uint32_t g_mem_dedup_hits = 0;
+uint32_t g_mem_dedup_total = 0;
 void printTaskList() {
     /*
     vTaskList((char *)&pcWriteBuffer);
@@ -101,6 +142,26 @@ void printTaskList() {
     printf("=================OS Loader Info==================\r\n");
     printf("VRAM PageFault:   %ld \n", g_page_vram_fault_cnt);
     printf("VROM PageFault:   %ld \n", g_page_vrom_fault_cnt);
+    printf("Soft PageFault:   %ld \n", g_page_soft_fault_cnt);
+    printf("VROM ReadAhead:   %ld \n", g_page_readahead_cnt);
+    printf("VROM Prefetch:    %ld \n", g_page_prefetch_cnt);
+    printf("VRAM FaultAround: %ld \n", g_page_fault_around_cnt);
+    printf("ZRAM Compress:    %ld \n", g_page_compress_cnt);
+    printf("ZRAM Raw Pages:   %ld \n", g_page_raw_cnt);
+    printf("ZRAM Largest Free: %ld.%ld%%, compact %ld, moved %ld\n", g_zram_frag / 10, g_zram_frag % 10,
+           g_zram_compact_cnt, g_zram_compact_moved);
+    printf("Swap:             out %ld, in %ld, sector writes %ld, errors %ld\n", g_swap_pages_out, g_swap_pages_in, g_swap_sector_writes, g_swap_write_errors);
+    printf("ZRAM Writeback:   %ld \n", g_page_writeback_cnt);
+    printf("Clean Evict:      %ld, avg %ld us\n", g_page_evict_clean_cnt,
+           g_page_evict_clean_cnt ? g_page_evict_clean_us / g_page_evict_clean_cnt : 0);
+    printf("Dirty Evict:      %ld, avg %ld us\n", g_page_evict_dirty_cnt,
+           g_page_evict_dirty_cnt ? g_page_evict_dirty_us / g_page_evict_dirty_cnt : 0);
+    printf("Page Promote:     %ld, moved %ld, demote %ld\n", g_page_promote_cnt, g_page_promote_moved, g_mmu_demote_cnt);
+    for (int i = 0; i < MAPLIST_INDEX_SEGS; i++) {
+        if (g_seg_dflpt_miss_cnt[i] || g_seg_fault_cnt[i]) {
+            printf("  Seg %08x:  DFLPT miss %ld, fault %ld\n", i << 20, g_seg_dflpt_miss_cnt[i], g_seg_fault_cnt[i]);
+        }
+    }
     printf("HCLK Freq:%ld MHz\n", HCLK_Freq / 1000000);
     printf("CPU Freq:%ld MHz\n", g_core_cur_freq_mhz);
     printf("Flash IO_Writes:%lu\n", g_mtd_write_cnt);
@@ -108,6 +169,34 @@ void printTaskList() {
     printf("Flash IO_Erases:%lu\n", g_mtd_erase_cnt);
     printf("Flash ECC Count:%lu\n", g_mtd_ecc_cnt);
     printf("Flash ECC FATAL:%lu\n", g_mtd_ecc_fatal_cnt);
+    printf("Flash Wait:%lu ms\n", g_mtd_wait_us / 1000);
+    for (int i = 0; i < MTD_LAT_CLASSES; i++) {
+        printf("  %s us>=", i == MTD_LAT_READ ? "RD" : i == MTD_LAT_PROG ? "WR" : "ER");
+        for (int b = 0; b < MTD_LAT_BUCKETS; b++) {
+            printf(" %lu:%lu", b ? ((uint32_t)MTD_LAT_BUCKET0_US << b) : 0, g_mtd_lat_hist[i][b]);
+        }
+        printf("\n");
+    }
+    {
+        uint32_t hits, misses;
+        FTL_GetMapCacheStats(&hits, &misses);
+        printf("FTL Map Cache:    hit %lu, miss %lu\n", hits, misses);
+    }
+    printf("FTL Write us: p50 <%lu, p90 <%lu, p99 <%lu, idle GC %lu\n",
+           FTL_GetWriteLatency(500), FTL_GetWriteLatency(900), FTL_GetWriteLatency(990), g_ftl_idle_gc_cnt);
+    printf("FTL Sector Writes:%lu, absorbed by cache:%lu\n", g_ftl_sector_writes, g_ftl_wcache_absorbed);
+    {
+        FTL_WearStats_t st;
+        FTL_GetWearStats(&st);
+        printf("FTL Erase Count: min %lu, max %lu, avg %lu, WL moved %lu\n", st.min, st.max, st.avg, st.migrated);
+    }
+    printf("Boot us: mtd %lu, ftl %lu (mount %lu by %s, %lu reads), vm %lu, system %lu\n",
+           g_boot_stage_us[BOOT_STAGE_MTD], g_boot_stage_us[BOOT_STAGE_FTL], g_ftl_mount_us, g_ftl_mount_fast ? "record" : "scan", g_ftl_mount_reads,
+           g_boot_stage_us[BOOT_STAGE_VM], g_boot_stage_us[BOOT_STAGE_SYSTEM]);
+    printf("Bad block lookups from RAM: %lu\n", g_ftl_bbt_hits);
+    printf("Scrub: marked %lu, refreshed %lu, raw %lu\n", g_mtd_scrub_marked, g_ftl_scrub_cnt, g_ftl_scrub_raw);
+    printf("FTL Relocated:%lu pages, %lu pages/s\n", g_ftl_copy_cnt,
+           g_ftl_copy_us ? (uint32_t)((uint64_t)g_ftl_copy_cnt * 1000000 / g_ftl_copy_us) : 0);
     printf("Batt Charge:%d\n", HW_POWER_STS.B.CHRGSTS);
     printf("PWD_BATTCHRG:%d\n", HW_POWER_CHARGE.B.PWD_BATTCHRG);
     printf("RTC:%ld\n", rtc_get_seconds());
@@ -118,6 +207,9 @@ void printTaskList() {
     mem_cr /= 16.0f;
     mem_cr /= 100.0f;
     printf("Memory Compression Rate:%d.%02d\n", (int)mem_cr, (int)(mem_cr * 100.0f));
+    printf("ZRAM Dedup Rate:%ld%% (%ld/%ld)\n",
+           g_mem_dedup_total ? g_mem_dedup_hits * 100 / g_mem_dedup_total : 0,
+           g_mem_dedup_hits, g_mem_dedup_total);
     printf("=============================================\r\n\n");
 
     // #include "cdmp.h"
@@ -256,6 +348,7 @@ void System(void *par) {
     // 1984 is the System page in options of Updater
     //atagsAddr = (uint32_t *)(VM_ROM_BASE + 3000 * 2048);
 
+    boardBootStage(BOOT_STAGE_SYSTEM);
     g_vm_status = VM_STATUS_RUNNING;
 
     for (int i = 180; i <= 202; ++i)
@@ -495,6 +588,44 @@ void parseCDCCommand(char *cmd) {
         return;
     }
 
+    if (strcmp(cmd, "WEARSTAT") == 0) {
+        FTL_WearStats_t st;
+        uint32_t hist[8] = {0};
+        char res[32];
+
+        FTL_GetWearStats(&st);
+        printf("Wear: min %ld (blk %ld), max %ld (blk %ld), avg %ld, bad %ld, migrated %ld\n",
+               st.min, st.minBlock + FLASH_DATA_BLOCK, st.max, st.maxBlock + FLASH_DATA_BLOCK, st.avg, st.bad, st.migrated);
+        // Erase counts relative to the minimum, in eighths of the spread (max included).
+        for (uint32_t b = 0; b < FTL_GetWearBlocks(); b++) {
+            uint32_t c = FTL_GetEraseCount(b);
+            if (c == FTL_WEAR_BAD) {
+                continue;
+            }
+            hist[(c - st.min) * 8 / (st.max - st.min + 1)]++;
+        }
+        for (int i = 0; i < 8; i++) {
+            printf("  >=%ld: %ld\n", st.min + ((st.max - st.min + 1) * i + 7) / 8, hist[i]);
+        }
+        sprintf(res, "WEAR:%ld,%ld,%ld\n", st.min, st.max, st.avg);
+        MscSetCmd(res);
+
+        return;
+    }
+
+    if (memcmp(cmd, "GCRATIO", 7) == 0) {
+        uint32_t part, ratio;
+        if (sscanf(cmd, "GCRATIO:%ld,%ld", &part, &ratio) != 2) {
+            MscSetCmd("GCERR\n");
+            return;
+        }
+        printf("GCRATIO:%ld,%ld\n", part, ratio);
+        FTL_SetGCRatio(part, ratio);
+        MscSetCmd("GCOK\n");
+
+        return;
+    }
+
     if (strcmp(cmd, "REBOOT") == 0) {
         portBoardReset();
         return;
@@ -592,6 +723,7 @@ void tud_cdc_rx_cb(uint8_t itf) {
             }
 
             if (strcmp(cdc_path_loader_buffer, "poweroff") == 0) {
+                FTL_Sync();
                 portBoardPowerOff();
                 goto fin;
             }
@@ -999,6 +1131,7 @@ void waitIRQ(int r) {
 }
 
 void vApplicationIdleHook(void) {
+    FTL_NotifyIdle();
     waitIRQ(0);
 }
 
@@ -1021,6 +1154,10 @@ volatile void _startup() {
     xTaskCreate(vTaskTinyUSB, "TinyUSB", configMINIMAL_STACK_SIZE, NULL, configMAX_PRIORITIES - 4, NULL);
 
     xTaskCreate(vVMMgrSvc, "VM Svc", configMINIMAL_STACK_SIZE, NULL, configMAX_PRIORITIES - 4, NULL);
+#if SEPARATE_VMM_CACHE
+    // Same priority as System, so it shares time slices with the guest instead of preempting it.
+    xTaskCreate(vVMWritebackSvc, "VM Writeback", configMINIMAL_STACK_SIZE, NULL, configMAX_PRIORITIES - 7, NULL);
+#endif
 
     xTaskCreate(vKeysSvc, "Keys Svc", configMINIMAL_STACK_SIZE, NULL, configMAX_PRIORITIES - 1, &pKevSvcTask);
 
@@ -16,6 +16,7 @@
 #include "vmMgr.h"
 
 #include "board_up.h"
+#include "FTL_up.h"
 #include "llapi.h"
 #include "llapi_code.h"
 
@@ -122,6 +123,7 @@ void volatile arm_do_swi(uint32_t SWINum, uint32_t *pRegFram) {
             break;
 
         case LL_FAST_SWI_SYSTEM_IDLE:
+            FTL_NotifyIdle();
             waitIRQ(0);
             break;
 
@@ -164,6 +166,25 @@ void volatile arm_do_swi(uint32_t SWINum, uint32_t *pRegFram) {
             break;
         }
 
+        case LL_FAST_SWI_MEM_ZRAM_FRAG:
+#if SEPARATE_VMM_CACHE
+            pRegFram[0 + 2] = zram_frag_info();
+#else
+            pRegFram[0 + 2] = 1000;
+#endif
+            break;
+
+        case LL_FAST_SWI_MEM_PREFETCH: {
+            // Only a hint, dropped when the fault queue is busy.
+            pageFaultInfo_t hint;
+            hint.FaultTask = NULL;
+            hint.FaultMemAddr = pRegFram[0 + 2];
+            hint.Len = pRegFram[1 + 2];
+            hint.FSR = FSR_PREFETCH;
+            xQueueSendFromISR(PageFaultQueue, &hint, &SwitchContext);
+            break;
+        }
+
         case LL_FAST_SWI_MEM_ENABLE_SWAP: {
 #if SEPARATE_VMM_CACHE
             extern bool mem_swap_enable;
@@ -184,6 +184,7 @@ static char msg3[] = "memory Compression.";
 static char msg4[] = "[ON]+[F6] > Reboot";
 void UI_OOM() {
     uidisp->emergencyBuffer();
+    uidisp->begin();
     uidisp->draw_box(0, 0, 255, 126, 192, 192);
     uidisp->draw_box(8, 8, 247, 118, 0, 0);
     uidisp->draw_box(214, 16, 228, 80, 128, 128);
@@ -192,6 +193,8 @@ void UI_OOM() {
     __puts(msg2, sizeof(msg2), 2, 12);
     __puts(msg3, sizeof(msg3), 3, 12);
     __puts(msg4, sizeof(msg4), 5, 12);
+    uidisp->commit();
+    uidisp->flush();
 }
 
 void pageUpdate() {
@@ -201,6 +204,7 @@ void pageUpdate() {
 
     getTimeStr(timeStr);
 
+    uidisp->begin();
     if (curPage == 1) {
         console->blink();
     }
@@ -273,10 +277,12 @@ void pageUpdate() {
     }
     if (isMsgBoxShow)
         msgbox->refresh();
+    uidisp->commit();
 }
 
 void drawPage(int page) {
 
+    uidisp->begin();
     uidisp->draw_box(mainw->content_x0,
                      mainw->content_y0,
                      mainw->content_x0 + mainw->content_width - 0,
@@ -322,6 +328,7 @@ void drawPage(int page) {
 
     if (isMsgBoxShow)
         msgbox->refresh();
+    uidisp->commit();
 }
 
 void UI_Refrush() {
@@ -405,9 +412,11 @@ void keyMsg(uint32_t key, int state) {
 
         case KEY_ON: {
             if (shift == 1) {
+                uidisp->begin();
                 uidisp->draw_box(0, 0, 255, 126, 255, 255);
                 uidisp->draw_bmp((char *)logo, 103, 32, 50, 25);
                 uidisp->draw_printf(128 - 14 * 6 / 2, 74, 12, 0, 255, "Shutting down");
+                uidisp->commit();
 
                 printf("Trig Power Off\n");
 
@@ -941,19 +950,23 @@ static void checkFS() {
 
     fres = f_mount(fs, FS_FLASH_PATH, 1);
     if (fres != FR_OK) {
+        uidisp->begin();
         uidisp->draw_printf(0, disp_off_y + 16 * 0, 16, 0, -1, "The flash is not initialized.");
         uidisp->draw_printf(0, disp_off_y + 16 * 1, 16, 0, -1, "Press [F2] to format.");
 
         uidisp->draw_printf(0, disp_off_y + 16 * 2, 16, 0, -1, UI_FS_init1);
         uidisp->draw_printf(0, disp_off_y + 16 * 3, 16, 0, -1, UI_FS_init2);
+        uidisp->commit();
 
         while (keys != KEY_F2) {
             vTaskDelay(pdMS_TO_TICKS(20));
             keys = ll_vm_check_key() & 0xFFFF;
         }
 
+        uidisp->begin();
         uidisp->draw_printf(0, disp_off_y + 16 * 5, 16, 0, -1, "Formatting...");
         uidisp->draw_printf(0, disp_off_y + 16 * 6, 16, 0, -1, UI_FS_init3);
+        uidisp->commit();
 
         BYTE *work = (BYTE *)pvPortMalloc(FF_MAX_SS);
         fres = f_mkfs(FS_FLASH_PATH, 0, work, FF_MAX_SS);
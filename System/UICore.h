@@ -21,6 +21,13 @@ private:
     uint8_t *disp_buf;
     int disp_w, disp_h;
     void (*drawf)(uint8_t *buf, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1);
+
+    // Rows drawn since the last flush, one bit each. While a batch is open
+    // (begin() without its commit()) they only accumulate. Any task may draw,
+    // so batch and dirty_rows are only touched inside a critical section.
+    uint32_t dirty_rows[(LCD_PIX_H + 31) / 32];
+    int batch = 0;
+
     inline void buf_set(uint32_t x, uint32_t y, uint8_t c) {
         if (disp_buf) {
             if ((x < this->disp_w) && (y < this->disp_h))
@@ -28,18 +35,117 @@ private:
         }
     }
 
+    void damage(uint32_t y0, uint32_t y1) {
+        if (y1 < y0) {
+            uint32_t t = y0;
+            y0 = y1;
+            y1 = t;
+        }
+        if (y0 >= this->disp_h) {
+            return;
+        }
+        if (y1 >= this->disp_h) {
+            y1 = this->disp_h - 1;
+        }
+        taskENTER_CRITICAL();
+        for (uint32_t y = y0; y <= y1; y++) {
+            dirty_rows[y / 32] |= 1UL << (y % 32);
+        }
+        bool flush = !batch;
+        taskEXIT_CRITICAL();
+        if (flush) {
+            flush_damage();
+        }
+    }
+
+    // One flush per run of dirty rows, the display takes whole rows only.
+    // The bitmap is taken and cleared in one go, drawf runs outside the lock.
+    void flush_damage() {
+        uint32_t rows[sizeof(dirty_rows) / sizeof(dirty_rows[0])];
+        uint32_t y = 0, start;
+
+        taskENTER_CRITICAL();
+        memcpy(rows, dirty_rows, sizeof(rows));
+        memset(dirty_rows, 0, sizeof(dirty_rows));
+        taskEXIT_CRITICAL();
+
+        while (y < this->disp_h) {
+            if (!(rows[y / 32] & (1UL << (y % 32)))) {
+                y++;
+                continue;
+            }
+            start = y;
+            while ((y < this->disp_h) && (rows[y / 32] & (1UL << (y % 32)))) {
+                y++;
+            }
+            if (disp_buf) {
+                this->drawf(&this->disp_buf[start * this->disp_w], 0, start, this->disp_w - 1, y - 1);
+                flush_calls++;
+                flush_bytes += (y - start) * this->disp_w;
+            }
+        }
+    }
+
 public:
+    uint32_t flush_calls = 0;
+    uint32_t flush_bytes = 0;
+
     UI_Display(int display_width, int display_height, void (*drawf)(uint8_t *buf, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1)) {
         printf("Create UI Display.\n");
+        if (display_height > LCD_PIX_H) {
+            display_height = LCD_PIX_H;
+        }
         this->disp_buf = (uint8_t *)pvPortMalloc(display_width * display_height);
         this->drawf = drawf;
         this->disp_w = display_width;
         this->disp_h = display_height;
-        memset(this->disp_buf, 0xff, display_width * display_height);
-        this->drawf(this->disp_buf, 0, 0, this->disp_w - 1, this->disp_h - 1);
+        memset(this->dirty_rows, 0, sizeof(this->dirty_rows));
+        if (this->disp_buf) {
+            memset(this->disp_buf, 0xff, display_width * display_height);
+            this->drawf(this->disp_buf, 0, 0, this->disp_w - 1, this->disp_h - 1);
+        }
+    }
+
+    /**
+     * @brief hold back flushes until the matching commit(), calls nest
+     */
+    void begin() {
+        taskENTER_CRITICAL();
+        batch++;
+        taskEXIT_CRITICAL();
     }
 
+    /**
+     * @brief close a begin(), the outermost one flushes every row drawn meanwhile
+     */
+    void commit() {
+        bool flush;
+        taskENTER_CRITICAL();
+        if (batch > 0) {
+            batch--;
+        }
+        flush = !batch;
+        taskEXIT_CRITICAL();
+        if (flush) {
+            flush_damage();
+        }
+    }
+
+    /**
+     * @brief push every dirty row now, whatever batch is open
+     */
+    void flush() {
+        flush_damage();
+    }
+
+    /**
+     * @brief switch to the reserved buffer for the OOM screen; batches left
+     *        open by the task that ran out of memory are dropped
+     */
     void emergencyBuffer() {
+        taskENTER_CRITICAL();
+        batch = 0;
+        taskEXIT_CRITICAL();
         disp_buf = (uint8_t *)(RAM_BASE + BASIC_RAM_SIZE - 33 * 1024);
     }
 
@@ -58,7 +164,7 @@ public:
 
     void draw_point(uint32_t x, uint32_t y, uint8_t c) {
         buf_set(x, y, c);
-        this->drawf(&this->disp_buf[y * this->disp_w], 0, y, this->disp_w - 1, y);
+        damage(y, y);
     }
     void draw_line(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, uint8_t c) {
         if (y0 == y1) {
@@ -90,9 +196,10 @@ public:
             }
         }
     draw_fin:
-        this->drawf(&this->disp_buf[y0 * this->disp_w], 0, y0, this->disp_w - 1, y1);
+        damage(y0, y1);
     }
     void draw_box(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, int16_t borderColor, int16_t fillColor) {
+        begin();
         if (fillColor != -1) {
             for (int y = y0; y <= y1; y++) {
                 draw_line(x0, y, x1, y, fillColor);
@@ -105,6 +212,7 @@ public:
             draw_line(x0, y0, x0, y1, borderColor);
             draw_line(x1, y0, x1, y1, borderColor);
         }
+        commit();
     }
 
     void draw_bmp(char *src, uint32_t x0, uint32_t y0, uint32_t w, uint32_t h) {
@@ -114,7 +222,7 @@ public:
             }
         }
 
-        this->drawf(&this->disp_buf[y0 * this->disp_w], 0, y0, this->disp_w - 1, y0 + h);
+        damage(y0, y0 + h - 1);
     }
 
     void draw_char_ascii(uint32_t x0, uint32_t y0, char ch, uint8_t fontSize, uint8_t fg, int16_t bg) {
@@ -167,7 +275,7 @@ public:
             pCh++;
         }
 
-        this->drawf(&this->disp_buf[y0 * this->disp_w], 0, y0, this->disp_w - 1, y0 + font_h - 1);
+        damage(y0, y0 + font_h - 1);
     }
     void draw_char_GBK16(uint32_t x0, uint32_t y0, uint16_t c, uint8_t fg, int16_t bg) {
         extern uint32_t fonts_hzk_start;
@@ -210,7 +318,7 @@ public:
             y++;
         }
         // printf("GBK PRINT:%02x\n", c);
-        this->drawf(&this->disp_buf[y0 * this->disp_w], 0, y0, this->disp_w - 1, y0 + 16);
+        damage(y0, y0 + 15);
     }
     int draw_printf(uint32_t x0, uint32_t y0, uint8_t fontSize, uint8_t fg, int16_t bg, const char *format, ...) {
         va_list aptr;
@@ -222,6 +330,7 @@ public:
         ret = vsprintf(buffer, format, aptr);
         va_end(aptr);
 
+        begin();
         for (int i = 0, x = x0; (i < sizeof(buffer)) && (buffer[i]); i++) {
             if (buffer[i] < 0x80) {
                 draw_char_ascii(x, y0, buffer[i], fontSize, fg, bg);
@@ -238,6 +347,7 @@ public:
                 i++;
             }
         }
+        commit();
         return (ret);
     }
     ~UI_Display() {
@@ -440,15 +550,18 @@ public:
     };
 
     void refreshTitle() {
+        disp->begin();
         disp->draw_box(x0 + 1, y0, x0 + width, y0 + WIN_DEFAULT_FONTSIZE - 3, WIN_DEFAULT_BORDER_COLOR, WIN_DEFAULT_TITLE_BG_COLOR);
         disp->draw_printf(x0 + 1, y0, WIN_DEFAULT_FONTSIZE, WIN_DEFAULT_TITLE_FONT_COLOR, WIN_DEFAULT_TITLE_BG_COLOR, this->title);
         // disp->draw_line(x0, WIN_DEFAULT_FONTSIZE, x0 + width, WIN_DEFAULT_FONTSIZE, WIN_DEFAULT_BORDER_COLOR);
+        disp->commit();
     }
 
     void refreshFuncKeyBar() {
         if (funcKey_enable) {
             uint32_t item_w = FUNCKEY_BAR_WITDH / 6;
 
+            disp->begin();
             disp->draw_box(FUNCKEY_BAR_X, FUNCKEY_BAR_Y, FUNCKEY_BAR_WITDH, FUNCKEY_BAR_Y + FUNCKEY_FONTSIZE, FUNCKEY_BAR_BG_COLOR, FUNCKEY_BAR_BG_COLOR);
 
             for (int i = 1; i < 6; i++) {
@@ -462,13 +575,16 @@ public:
                                       3 + strlen(this->funcKey[i]) / 2, this->funcKey[i], 3 - strlen(this->funcKey[i]) / 2, "");
                 }
             }
+            disp->commit();
         }
     }
 
     void refreshWindow() {
+        disp->begin();
         disp->draw_box(0, 0, width - 2, height - 1, WIN_DEFAULT_BORDER_COLOR, WIN_DEFAULT_BG_COLOR);
         refreshTitle();
         refreshFuncKeyBar();
+        disp->commit();
     }
 
     /*
@@ -567,10 +683,12 @@ public:
     }
 
     void refresh() {
+        disp->begin();
         disp->draw_box(this->x0, this->y0, this->x0 + this->width, this->y0 + this->height, 0, 224);
         disp->draw_line(this->x0, this->y0 + 16, this->x0 + this->width, this->y0 + 16, 0);
         disp->draw_printf(this->x0 + 4, this->y0 + 4, 12, 0, 224, "%s", this->title);
         disp->draw_printf(this->text_x0, this->text_y0, 12, 0, 224, "%s", this->text);
+        disp->commit();
     }
 
     bool show() {
@@ -931,6 +1049,7 @@ struct SimpShell {
      */
     void refresh() {
         // uidisp->draw_box(DISPX, DISPY, DISPX + DISPW, DISPY + DISPH, -1, 255);
+        uidisp->begin();
         for (int i = 0; i < CONSH; i++) {
                 uidisp->draw_box(DISPX, DISPY + 8 * i, DISPX + DISPW, DISPY + 8 * (i+1), -1, 255);
             for (int j = 0; j < CONSW; j++) {
@@ -940,6 +1059,7 @@ struct SimpShell {
         if (this->cursorBlink) {
             this->blink();
         }
+        uidisp->commit();
     }
 
     /**
@@ -951,6 +1071,7 @@ struct SimpShell {
      * @param y1 end y pos
      */
     void refresh(const uint32_t &x0, const uint32_t &y0, const uint32_t &x1, const uint32_t &y1) {
+        uidisp->begin();
         uidisp->draw_box(DISPX + (FONTS == 8 ? 6 : 8) * x0, DISPY + FONTS * y0, DISPX + (FONTS == 8 ? 6 : 8) * x1, DISPY + FONTS * y1, -1, 255);
         for (int i = 0; i < CONSH; i++) {
             for (int j = 0; j < CONSW; j++) {
@@ -960,6 +1081,7 @@ struct SimpShell {
         if (this->cursorBlink) {
             this->blink();
         }
+        uidisp->commit();
     }
 
     /**
@@ -1077,12 +1199,14 @@ struct SimpShell {
         if (!this->cursorBlink)
             return;
         cursor_displaying = !cursor_displaying;
+        uidisp->begin();
         if (cursor_displaying) {
             uidisp->draw_line(DISPX + (FONTS == 8 ? 6 : 8) * cx, DISPY + FONTS * cy, DISPX + (FONTS == 8 ? 6 : 8) * cx, DISPY + FONTS * (cy + 1) - 1, 0);
         } else {
             uidisp->draw_line(DISPX + (FONTS == 8 ? 6 : 8) * cx, DISPY + FONTS * cy, DISPX + (FONTS == 8 ? 6 : 8) * cx, DISPY + FONTS * (cy + 1) - 1, 255);
             uidisp->draw_char_ascii(DISPX + (FONTS == 8 ? 6 : 8) * cx, DISPY + 8 * cy, lin[cy].col[cx], FONTS, 0, 255);
         }
+        uidisp->commit();
     }
 };
 #undef DISPX
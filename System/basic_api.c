@@ -29,7 +29,16 @@ void api_vram_flush(void)
 {
     if(svram)
     {
-        ll_disp_put_area(svram, 0, 0, 255, 126);
+        // Callers may also write the buffer directly, so every row is sent.
+        ll_disp_packed_t desc = {
+            .buf = svram,
+            .bpp = 8,
+            .y0 = 0,
+            .y1 = 126,
+            .palette = NULL,
+            .dirty = NULL,
+        };
+        ll_disp_put_packed(&desc);
     }
 }
 
@@ -46,36 +46,50 @@ static bool cursor_enable = false;
 
 static bool concur_reverse = false;
 
-static bool ImmediateRefrush = false;
+#define VGL_POLL_MS     (300)   // catches drawing that did not request a flush
+#define VGL_SETTLE_MS   (50)    // lets a burst of drawing end up in one flush
+
+// Rows changed since the last flush, only those are sent to the LCD.
+static uint32_t vgl_dirty[(VIR_LCD_PIX_H + 31) / 32];
+#define VGL_MARK_ROW(y)  (vgl_dirty[(y) >> 5] |= 1UL << ((y) & 31))
+
+static TaskHandle_t vgl_flush_task = NULL;
 extern bool khicasRunning;
 int khicas_1bpp=1; // assumes W is a multiple of 8
 
+void vGL_requestFlush()
+{
+    if (vgl_flush_task)
+        xTaskNotifyGive(vgl_flush_task);
+}
+
 void vGL_FlushVScreen()
 {
+  uint32_t dirty[(VIR_LCD_PIX_H + 31) / 32];
+  uint32_t any = 0;
+
+  // Rows drawn after this point stay marked for the next flush.
+  taskENTER_CRITICAL();
+  for (int i = 0; i < sizeof(dirty) / sizeof(dirty[0]); i++) {
+    dirty[i] = vgl_dirty[i];
+    vgl_dirty[i] = 0;
+    any |= dirty[i];
+  }
+  taskEXIT_CRITICAL();
+  if (!any)
+    return;
+
   if (khicas_1bpp){
-    char *src=screen_1bpp;
-    for (int r=0;r<VIR_LCD_PIX_H;++r){
-      char tab[VIR_LCD_PIX_W];
-      char *dest=tab,*end=dest+VIR_LCD_PIX_W;
-      for (;dest<end;dest+=8,++src){
-        char cur=*src;
-        if (cur){
-          dest[0]=(cur&1)?0xff:0; 
-          dest[1]=(cur&2)?0xff:0; 
-          dest[2]=(cur&4)?0xff:0; 
-          dest[3]=(cur&8)?0xff:0; 
-          dest[4]=(cur&16)?0xff:0; 
-          dest[5]=(cur&32)?0xff:0; 
-          dest[6]=(cur&64)?0xff:0; 
-          dest[7]=(cur&128)?0xff:0; 
-        }
-        else {
-          *((unsigned *) dest)=0;
-          *((unsigned *) &dest[4])=0;
-        }
-      }
-      ll_disp_put_area(tab, 0, r, VIR_LCD_PIX_W - 1, r);      
-    }
+    // the loader expands the packed rows itself, set bits are 0xff
+    ll_disp_packed_t desc = {
+      .buf = (const uint8_t *)screen_1bpp,
+      .bpp = 1,
+      .y0 = 0,
+      .y1 = VIR_LCD_PIX_H - 1,
+      .palette = NULL,
+      .dirty = dirty,
+    };
+    ll_disp_put_packed(&desc);
     return;
   }
 #if SCALE_ENABLE
@@ -116,6 +130,7 @@ void vGL_set_pixel(unsigned x,unsigned y,int c){
   }
   else
     virtual_screen[x + y * VIR_LCD_PIX_W] = c;
+  VGL_MARK_ROW(y);
 }
 
 void vGL_SetPoint(unsigned int x, unsigned int y, int c)
@@ -238,7 +253,7 @@ void vGL_putString(int x0, int y0, const char *s, int fg, int bg, int fontSize)
         }
     }
     
-    ImmediateRefrush = true;
+    vGL_requestFlush();
 }
 
 void vGL_clearArea(unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1) {
@@ -263,7 +278,7 @@ void vGL_clearArea(unsigned int x0, unsigned int y0, unsigned int x1, unsigned i
     }
     
     
-    ImmediateRefrush = true;
+    vGL_requestFlush();
 }
 
 void vGL_setArea(unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1, unsigned int color) 
@@ -288,7 +303,7 @@ void vGL_setArea(unsigned int x0, unsigned int y0, unsigned int x1, unsigned int
             }
         }
 
-    ImmediateRefrush = true;
+    vGL_requestFlush();
 }
 
 void vGL_ConsLocate(int x, int y)
@@ -325,6 +340,7 @@ void vGL_reverseArea(unsigned int x0, unsigned int y0, unsigned int x1, unsigned
           int pos=(x+VIR_LCD_PIX_W*y)>>3;
           screen_1bpp[pos] ^= shift; 
         }
+        VGL_MARK_ROW(y);
       }
     }
     else {
@@ -332,29 +348,22 @@ void vGL_reverseArea(unsigned int x0, unsigned int y0, unsigned int x1, unsigned
         for (int x = x0; x < x1; x++) {
           virtual_screen[x + y * VIR_LCD_PIX_W] = ~virtual_screen[x + y * VIR_LCD_PIX_W];
         }
+        VGL_MARK_ROW(y);
       }
     }
-    ImmediateRefrush = true;
+    vGL_requestFlush();
     //vGL_FlushVScreen();
 }
 
 static void vGL_flushTask(void *arg)
 {
-    unsigned int _delay;
     while(1)
     {
-        vTaskDelay(pdMS_TO_TICKS(50));
-        if(ImmediateRefrush){
-            vGL_FlushVScreen(); 
-            ImmediateRefrush = false;
-            _delay = 0;
-        }else{
-            _delay++;
-            if(_delay > 5){
-                _delay = 0;
-                vGL_FlushVScreen(); 
-            }
+        // Nothing is sent while the screen is unchanged.
+        if(ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(VGL_POLL_MS))){
+            vTaskDelay(pdMS_TO_TICKS(VGL_SETTLE_MS));
         }
+        vGL_FlushVScreen();
 
         if(!khicasRunning)
         {
@@ -415,6 +424,7 @@ int vGL_Initialize() {
   if (!screen_1bpp) 
     return -1;
   memset(screen_1bpp, COLOR_WHITE, VIR_LCD_PIX_H * VIR_LCD_PIX_W / 8);
+  memset(vgl_dirty, 0xFF, sizeof(vgl_dirty));
 
   if (!virtual_screen)
     virtual_screen = pvPortMalloc(VIR_LCD_PIX_H * VIR_LCD_PIX_W);
@@ -439,7 +449,7 @@ int vGL_Initialize() {
 #endif
 
 
-    xTaskCreate(vGL_flushTask, "vGLRefTsk", 512, NULL, configMAX_PRIORITIES - 3, NULL);
+    xTaskCreate(vGL_flushTask, "vGLRefTsk", 512, NULL, configMAX_PRIORITIES - 3, &vgl_flush_task);
     xTaskCreate(vGL_consoleTask, "vGLConsoleTsk", 512, NULL, configMAX_PRIORITIES - 3, NULL);
 
     //vGL_FlushVScreen();
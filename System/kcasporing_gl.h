@@ -19,6 +19,7 @@ void vGL_reverseArea(unsigned int x0, unsigned int y0, unsigned int x1, unsigned
 void vGL_clearArea(unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1) ;
 void vGL_setArea(unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1, unsigned int color) ;
 void vGL_FlushVScreen();
+void vGL_requestFlush();
 int vGL_GetPoint(unsigned int x, unsigned int y);
 void vGL_SetPoint(unsigned int x, unsigned int y, int c);
 
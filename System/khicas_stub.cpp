@@ -493,7 +493,7 @@ int Bdisp_GetPoint_VRAM(int x, int y) {
 }
 
 void Bdisp_PutDisp_DD() {
-    // vGL_FlushVScreen();
+    vGL_requestFlush();
     // printf("Bdisp_PutDisp_DD\n");
 } 
  
@@ -43,6 +43,8 @@ DECDEF_LLSWI(void,         ll_disp_put_area,      (uint8_t *vbuffer,
                                                    uint32_t x0, uint32_t y0,
                                                    uint32_t x1, uint32_t y1)              ,LL_SWI_DISPLAY_FLUSH           );
 
+DECDEF_LLSWI(void,         ll_disp_put_packed,    (const ll_disp_packed_t *desc)          ,LL_SWI_DISPLAY_FLUSH_PACKED    );
+
 DECDEF_LLSWI(void,         ll_disp_set_indicator, (int indicateBit, int BatInt)           ,LL_SWI_DISPLAY_SET_INDICATION  );
 
 DECDEF_LLSWI(uint32_t,     ll_serial_getch,       (void)                                  ,LL_SWI_SERIAL_GETCH             );
@@ -85,6 +87,8 @@ DECDEF_LLSWI(uint32_t,     ll_mem_phy_info,             (uint32_t *free, uint32_
 DECDEF_LLSWI(float,        ll_mem_comprate,             (void)                                  ,LL_FAST_SWI_MEM_COMPRATE               );
 DECDEF_LLSWI(void,         ll_mem_swap_enable,          (uint32_t enable)                       ,LL_FAST_SWI_MEM_ENABLE_SWAP                );
 DECDEF_LLSWI(uint32_t,     ll_mem_swap_size,          (void)                                  ,LL_FAST_SWI_MEM_SWAP_SIZE                );
+DECDEF_LLSWI(void,         ll_mem_prefetch,           (uint32_t addr, uint32_t size)          ,LL_FAST_SWI_MEM_PREFETCH                );
+DECDEF_LLSWI(uint32_t,     ll_mem_zram_frag,          (void)                                  ,LL_FAST_SWI_MEM_ZRAM_FRAG                );
 
 
 #ifdef __cplusplus          
@@ -35,6 +35,7 @@
 
 #define LL_SWI_DISPLAY_FLUSH           (LL_SWI_BASE + 21)
 #define LL_SWI_DISPLAY_SET_INDICATION  (LL_SWI_BASE + 22)
+#define LL_SWI_DISPLAY_FLUSH_PACKED    (LL_SWI_BASE + 23)
 
 
 #define LL_SWI_SET_KEY_REPORT          (LL_SWI_BASE + 30)
@@ -86,6 +87,8 @@
 #define LL_FAST_SWI_MEM_COMPRATE             (LL_FAST_SWI_BASE + 101)
 #define LL_FAST_SWI_MEM_ENABLE_SWAP          (LL_FAST_SWI_BASE + 102)
 #define LL_FAST_SWI_MEM_SWAP_SIZE            (LL_FAST_SWI_BASE + 103)
+#define LL_FAST_SWI_MEM_PREFETCH             (LL_FAST_SWI_BASE + 104)
+#define LL_FAST_SWI_MEM_ZRAM_FRAG            (LL_FAST_SWI_BASE + 105)
 
 
 
@@ -96,6 +99,18 @@
 
 
 
+// Parameter block of LL_SWI_DISPLAY_FLUSH_PACKED.
+// buf holds full width rows of 256 pixels from row 0, leftmost pixel in the low bits of each byte.
+typedef struct ll_disp_packed_t {
+    const uint8_t *buf;
+    uint32_t bpp;                   // 1, 2 or 8
+    uint32_t y0, y1;                // rows to consider
+    const uint8_t *palette;         // gray level of each of the (1 << bpp) values, NULL for a linear ramp, unused at 8bpp
+    const uint32_t *dirty;          // bit y set for each row to send, NULL for all rows
+} ll_disp_packed_t;
+
+
+
 #define SYS_APP_EXIT                            (SYS_SWI_BASE + 1)
 #define SYS_APP_SLEEP_MS                        (SYS_SWI_BASE + 2)
 